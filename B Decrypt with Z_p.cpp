@@ -3,91 +3,418 @@
 #include <vector>
 #include <string>
 #include <time.h>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <cstring>
 
 using namespace std;
 typedef unsigned long long ll;
 ll p;
-int sz = 7;
-ll max_rank = 10'000'000;
 
+// --stats: cumulative time per stage and per-message latency percentiles,
+// printed to stderr at exit; --stats-json <file> writes them as JSON instead.
+// Stages nest (e.g. mpow inside rev), so their times overlap.
+enum Stage { PARSE, RADIX, MPOW, REV, OUTPUT, STAGES };
+const char* stage_names[STAGES] = { "parse", "radix", "mpow", "rev", "output" };
+
+struct Stats {
+    static constexpr int buckets = 256; // 4 buckets per power of two nanoseconds
+    bool enabled = false;
+    string json_path;
+    atomic<long long> stage_ns[STAGES] = {};
+    atomic<long long> latency[buckets] = {};
+    atomic<long long> messages{ 0 }, max_latency{ 0 };
+
+    static long long now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void add_latency(long long ns) {
+        int bucket = ns > 1 ? min(buckets - 1, (int)(4 * log2((double)ns))) : 0;
+        ++latency[bucket];
+        ++messages;
+        long long cur = max_latency;
+        while (ns > cur && !max_latency.compare_exchange_weak(cur, ns));
+    }
+
+    // upper bound of the bucket holding the q-th quantile, in microseconds
+    double percentile(double q) const {
+        long long need = max(1LL, (long long)ceil(q * messages)), seen = 0;
+        for (int i = 0; i < buckets; ++i) {
+            seen += latency[i];
+            if (seen >= need) return min(exp2((i + 1) / 4.0), (double)max_latency) / 1e3;
+        }
+        return max_latency / 1e3;
+    }
+
+    void report() const {
+        const double qs[] = { 0.5, 0.9, 0.99 };
+        const char* names[] = { "p50", "p90", "p99" };
+        if (json_path.empty()) {
+            cerr << "stage     total_ms\n";
+            for (int i = 0; i < STAGES; ++i)
+                cerr << left << setw(10) << stage_names[i] << stage_ns[i] / 1e6 << '\n';
+            cerr << "latency_us messages=" << messages;
+            for (int i = 0; i < 3; ++i)
+                cerr << ' ' << names[i] << '=' << (messages ? percentile(qs[i]) : 0);
+            cerr << " max=" << max_latency / 1e3 << '\n';
+            return;
+        }
+        ofstream os(json_path);
+        os << "{\"stages_ms\": {";
+        for (int i = 0; i < STAGES; ++i)
+            os << (i ? ", " : "") << '"' << stage_names[i] << "\": " << stage_ns[i] / 1e6;
+        os << "}, \"latency_us\": {\"messages\": " << messages;
+        for (int i = 0; i < 3; ++i)
+            os << ", \"" << names[i] << "\": " << (messages ? percentile(qs[i]) : 0);
+        os << ", \"max\": " << max_latency / 1e3 << "}}\n";
+    }
+
+    ~Stats() {
+        if (enabled) report();
+    }
+} stats;
+
+// Instrumentation build (-DCOUNT_OPS): counts arithmetic operations and heap
+// allocations per high-level operation and prints them to stderr at exit.
+#ifdef COUNT_OPS
+enum Op_kind { MUL, SQR, RED, DIV, INV, ALLOC, OP_KINDS };
+const char* op_kind_names[OP_KINDS] = { "mul", "sqr", "reduce", "div", "inv", "alloc" };
+thread_local long long op_count[OP_KINDS];
+thread_local const char* op_stack[32];
+thread_local int op_depth;
+
+struct Op_report {
+    struct Totals {
+        long long calls = 0;
+        long long count[OP_KINDS] = {};
+    };
+    mutex mtx;
+    map<string, Totals> ops;
+
+    ~Op_report() {
+        cerr << left << setw(20) << "op" << setw(10) << "calls";
+        for (auto name : op_kind_names)
+            cerr << setw(12) << name;
+        cerr << "(per call)\n";
+        for (auto& [name, t] : ops) {
+            cerr << setw(20) << name << setw(10) << t.calls;
+            for (auto c : t.count)
+                cerr << setw(12) << (double)c / t.calls;
+            cerr << '\n';
+        }
+    }
+} op_report;
+
+// only the outermost scope of a name is counted, so recursion is one call
+// calls > 1 counts a batch of that many independent calls at once
+class Op_scope {
+    const char* name = nullptr;
+    int calls;
+    long long start[OP_KINDS];
+    public:
+    explicit Op_scope(const char* name, int calls = 1) : calls(calls) {
+        for (int i = 0; i < op_depth; ++i)
+            if (op_stack[i] == name) return;
+        this->name = name;
+        op_stack[op_depth++] = name;
+        copy(op_count, op_count + OP_KINDS, start);
+    }
+    ~Op_scope() {
+        if (!name) return;
+        --op_depth;
+        long long delta[OP_KINDS];
+        for (int i = 0; i < OP_KINDS; ++i)
+            delta[i] = op_count[i] - start[i];
+        lock_guard<mutex> lock(op_report.mtx);
+        auto& t = op_report.ops[name];
+        t.calls += calls;
+        for (int i = 0; i < OP_KINDS; ++i)
+            t.count[i] += delta[i];
+    }
+};
+
+// the replacements pair malloc with free, gcc only sees new paired with free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t n) {
+    ++op_count[ALLOC];
+    if (void* ptr = malloc(n ? n : 1)) return ptr;
+    throw bad_alloc();
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+#pragma GCC diagnostic pop
+
+#define COUNT_OP(kind) (++op_count[kind])
+#define COUNT_OP_N(kind, n) (op_count[kind] += (n))
+#define OP_SCOPE(...) Op_scope op_scope_(__VA_ARGS__)
+#else
+#define COUNT_OP(kind) ((void)0)
+#define COUNT_OP_N(kind, n) ((void)0)
+#define OP_SCOPE(...) ((void)0)
+#endif
+
+thread_local int stage_depth[STAGES];
+
+// only the outermost timer of a stage on each thread is counted
+class Stage_timer {
+    Stage stage;
+    bool running;
+    long long start = 0;
+    public:
+    explicit Stage_timer(Stage stage) : stage(stage), running(stats.enabled) {
+        if (running && stage_depth[stage]++ == 0) start = Stats::now();
+    }
+    void stop() {
+        if (!running) return;
+        running = false;
+        if (--stage_depth[stage] == 0) stats.stage_ns[stage] += Stats::now() - start;
+    }
+    ~Stage_timer() { stop(); }
+};
+
+// blocks > 1 times a batch and records each of its blocks as one message
+class Message_timer {
+    long long start = 0;
+    int blocks;
+    public:
+    explicit Message_timer(int blocks = 1) : blocks(blocks) {
+        if (stats.enabled) start = Stats::now();
+    }
+    ~Message_timer() {
+        if (!stats.enabled) return;
+        long long ns = (Stats::now() - start) / blocks;
+        for (int i = 0; i < blocks; ++i) stats.add_latency(ns);
+    }
+};
+
+// Non-negative integer on 64-bit binary limbs, least significant first.
+// Zero is the empty vector.
 class Number {
     vector<ll> val;
+
+    void trim() {
+        while (!val.empty() && val.back() == 0) val.pop_back();
+    }
+
     public:
-    Number(ll num) : val({ num }) {}
-    Number(vector<ll> mas) : val(mas) {}
+    Number(ll num = 0) {
+        if (num) val.push_back(num);
+    }
+    Number(vector<ll> mas) : val(move(mas)) { trim(); }
+
+    Number& operator+=(const Number& other) {
+        if (val.size() < other.val.size()) val.resize(other.val.size());
+        ll carry = 0;
+        for (size_t i = 0; i < val.size() && (carry || i < other.val.size()); ++i) {
+            unsigned __int128 cur = (unsigned __int128)val[i] + other[i] + carry;
+            val[i] = (ll)cur;
+            carry = (ll)(cur >> 64);
+        }
+        if (carry) val.push_back(carry);
+        return *this;
+    }
     Number operator+ (const Number& other) const {
-        vector<ll> res(max(other.val.size(), this->val.size()) + 1);
-        for (int i = 0; i + 1 < res.size(); ++i) {
-            res[i] += (*this)[i] + other[i];
-            if (res[i] >= max_rank) {
-                ++res[i + 1];
-                res[i] -= max_rank;
-            }
+        return Number(*this) += other;
+    }
+    Number& operator*=(const ll d) {
+        COUNT_OP(MUL);
+        ll carry = 0;
+        for (auto& el : val) {
+            unsigned __int128 cur = (unsigned __int128)el * d + carry;
+            el = (ll)cur;
+            carry = (ll)(cur >> 64);
         }
-        while (res.size() > 1 && res.back() == 0) res.pop_back();
-        return Number(res);
+        if (carry) val.push_back(carry);
+        trim();
+        return *this;
     }
     Number operator* (const Number& other) const {
+        COUNT_OP(&other == this ? SQR : MUL);
         vector<ll> res(other.val.size() + this->val.size());
-        for (int i = 0; i < this->val.size(); ++i) {
-            for (int j = 0; j < other.val.size(); ++j) {
-                res[i + j] += this->val[i] * other.val[j];
-                int ind = i + j;
-                while (res[ind] >= max_rank) {
-                    if (ind + 1 == res.size()) {
-                        res.push_back(0);
-                    }
-                    res[ind + 1] += res[ind] / max_rank;
-                    res[ind] %= max_rank;
-                    ++ind;
-                }
+        for (size_t i = 0; i < this->val.size(); ++i) {
+            ll carry = 0;
+            for (size_t j = 0; j < other.val.size(); ++j) {
+                unsigned __int128 cur = (unsigned __int128)this->val[i] * other.val[j] + res[i + j] + carry;
+                res[i + j] = (ll)cur;
+                carry = (ll)(cur >> 64);
             }
+            res[i + other.val.size()] = carry;
         }
-        while (res.size() != 0 && res.back() == 0) res.pop_back();
-        if (res.size() == 0)res = { 0 };
-        return Number(res);
+        return Number(move(res));
+    }
+    Number& operator*=(const Number& other) {
+        return *this = *this * other;
     }
     bool operator==(const Number& other) const {
-        if (this->val.size() != other.val.size()) {
-            return false;
-        }
-        for (int i = this->val.size() - 1; i >= 0; --i) {
-            if (this->val[i] != other.val[i]) {
-                return false;
-            }
-        }
-        return true;
+        return this->val == other.val;
     }
     bool operator>(const Number& other) const {
         if (this->val.size() != other.val.size()) {
             return this->val.size() > other.val.size();
         }
-        for (int i = this->val.size() - 1; i >= 0; --i) {
+        for (int i = (int)this->val.size() - 1; i >= 0; --i) {
             if (this->val[i] != other.val[i]) {
                 return this->val[i] > other.val[i];
             }
         }
         return false;
     }
+    bool isZero() const {
+        return val.empty();
+    }
 
-    Number operator/=(const ll d) {
-        for (int i = val.size() - 1; i > 0; --i) {
-            val[i - 1] += val[i] % d * max_rank;
-            val[i] /= d;
+    // divides in place and returns the remainder in one pass
+    ll divmod_small(const ll d) {
+        COUNT_OP(DIV);
+        unsigned __int128 rem = 0;
+        for (int i = (int)val.size() - 1; i >= 0; --i) {
+            unsigned __int128 cur = rem << 64 | val[i];
+            val[i] = (ll)(cur / d);
+            rem = cur % d;
         }
-        val[0] /= d;
-        while (val.size() != 0 && val.back() == 0) val.pop_back();
-        if (val.size() == 0)val = { 0 };
+        trim();
+        return (ll)rem;
+    }
+
+    Number& operator/=(const ll d) {
+        divmod_small(d);
         return *this;
     }
 
     ll operator%(const ll d) const {
-        vector<ll> val = this->val;
-        for (int i = val.size() - 1; i > 0; --i) {
-            val[i - 1] += val[i] % d * max_rank;
-            val[i] /= d;
+        COUNT_OP(RED);
+        unsigned __int128 rem = 0;
+        for (int i = (int)val.size() - 1; i >= 0; --i) {
+            rem = (rem << 64 | val[i]) % d;
         }
-        return val[0] % d;
+        return (ll)rem;
+    }
+
+    // *this >= other
+    Number& operator-=(const Number& other) {
+        ll borrow = 0;
+        for (size_t i = 0; i < val.size(); ++i) {
+            unsigned __int128 cur = (unsigned __int128)val[i] - other[i] - borrow;
+            val[i] = (ll)cur;
+            borrow = (ll)(cur >> 64) & 1;
+        }
+        trim();
+        return *this;
+    }
+    Number operator- (const Number& other) const {
+        return Number(*this) -= other;
+    }
+
+    int bits() const {
+        return val.empty() ? 0 : 64 * (int)val.size() - __builtin_clzll(val.back());
+    }
+    bool bit(int i) const {
+        return (*this)[i / 64] >> (i % 64) & 1;
+    }
+    const vector<ll>& limbs() const {
+        return val;
+    }
+
+    // Knuth's algorithm D: divides in place by d and returns the remainder
+    Number divmod(const Number& d) {
+        if (d.val.size() == 1) return Number(divmod_small(d.val[0]));
+        COUNT_OP(DIV);
+        if (d > *this) {
+            Number rem = move(*this);
+            val.clear();
+            return rem;
+        }
+        size_t n = d.val.size(), m = val.size() - n;
+        int s = __builtin_clzll(d.val.back());
+        // shift both so that the top limb of v has its high bit set
+        auto shifted = [s](const vector<ll>& a, size_t len) {
+            vector<ll> res(len);
+            for (size_t i = 0; i < len; ++i) {
+                ll lo = i < a.size() ? a[i] : 0, below = i && i - 1 < a.size() ? a[i - 1] : 0;
+                res[i] = s ? lo << s | below >> (64 - s) : lo;
+            }
+            return res;
+        };
+        vector<ll> v = shifted(d.val, n), u = shifted(val, val.size() + 1), q(m + 1);
+        for (size_t j = m + 1; j-- > 0;) {
+            unsigned __int128 top = (unsigned __int128)u[j + n] << 64 | u[j + n - 1];
+            unsigned __int128 qhat = top / v[n - 1], rhat = top % v[n - 1];
+            while (qhat >> 64 || qhat * v[n - 2] > (rhat << 64 | u[j + n - 2])) {
+                --qhat, rhat += v[n - 1];
+                if (rhat >> 64) break;
+            }
+            // u[j..j+n] -= qhat * v, adding v back if qhat was still one too large
+            ll carry = 0, borrow = 0;
+            for (size_t i = 0; i < n; ++i) {
+                unsigned __int128 prod = qhat * v[i] + carry;
+                carry = (ll)(prod >> 64);
+                unsigned __int128 cur = (unsigned __int128)u[i + j] - (ll)prod - borrow;
+                u[i + j] = (ll)cur;
+                borrow = (ll)(cur >> 64) & 1;
+            }
+            unsigned __int128 cur = (unsigned __int128)u[j + n] - carry - borrow;
+            u[j + n] = (ll)cur;
+            if ((ll)(cur >> 64) & 1) {
+                --qhat, carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    unsigned __int128 sum = (unsigned __int128)u[i + j] + v[i] + carry;
+                    u[i + j] = (ll)sum;
+                    carry = (ll)(sum >> 64);
+                }
+                u[j + n] += carry;
+            }
+            q[j] = (ll)qhat;
+        }
+        vector<ll> rem(n);
+        for (size_t i = 0; i < n; ++i)
+            rem[i] = s ? u[i] >> s | u[i + 1] << (64 - s) : u[i];
+        val = move(q);
+        trim();
+        return Number(move(rem));
+    }
+
+    static Number from_decimal(const string& str) {
+        Number res;
+        for (size_t pos = 0; pos < str.size(); pos += 19) {
+            size_t len = min((size_t)19, str.size() - pos);
+            ll mult = 1;
+            for (size_t i = 0; i < len; ++i) mult *= 10;
+            res *= mult;
+            res += Number(stoull(str.substr(pos, len)));
+        }
+        return res;
+    }
+
+    string to_decimal() const {
+        if (val.empty()) return "0";
+        Number num = *this;
+        vector<ll> parts;
+        while (!num.isZero()) parts.push_back(num.divmod_small(10000000000000000000ULL));
+        string res = to_string(parts.back());
+        char buf[24];
+        for (int i = (int)parts.size() - 2; i >= 0; --i) {
+            snprintf(buf, sizeof(buf), "%019llu", parts[i]);
+            res += buf;
+        }
+        return res;
+    }
+
+    friend istream& operator>>(istream& in, Number& num) {
+        string str;
+        if (in >> str) num = from_decimal(str);
+        return in;
+    }
+    friend ostream& operator<<(ostream& out, const Number& num) {
+        return out << num.to_decimal();
     }
 
     ll operator[] (int i) const {
@@ -98,6 +425,14 @@ class Number {
     }
 };
 
+// largest power of any that fits into a limb, and its exponent
+pair<ll, int> limb_power(ll any) {
+    ll chunk = any;
+    int k = 1;
+    while (chunk <= ~0ULL / any) chunk *= any, ++k;
+    return { chunk, k };
+}
+
 
 int char_to_number(char symbol) {
     if (symbol >= 48 && symbol <= 57)
@@ -128,30 +463,52 @@ char number_to_char(int num) {
 }
 
 Number from_any_to_10(vector<ll>& num, ll any) {
+    Stage_timer timer(RADIX);
+    OP_SCOPE("from_any_to_10");
+    auto [chunk, k] = limb_power(any);
     Number res(0);
-    Number st(1);
-    for (auto b : num) {
-        res = res + st * b;
-        st = st * Number(any);
+    ll acc = 0, mult = 1;
+    for (auto it = num.rbegin(); it != num.rend(); ++it) {
+        acc = acc * any + *it;
+        mult *= any;
+        if (mult == chunk) {
+            res *= mult;
+            res += acc;
+            acc = 0, mult = 1;
+        }
+    }
+    if (mult > 1) {
+        res *= mult;
+        res += acc;
     }
     return res;
 }
 
 vector<ll> from_10_to_any(Number num, ll any) {
+    Stage_timer timer(RADIX);
+    OP_SCOPE("from_10_to_any");
     vector<ll> res;
-    if (num == 0) return { 0 };
-    while (num > 0) {
-        res.push_back(num % any);
-        num /= any;
+    if (num.isZero()) return { 0 };
+    auto [chunk, k] = limb_power(any);
+    while (!num.isZero()) {
+        ll rem = num.divmod_small(chunk);
+        for (int i = 0; i < k; ++i) {
+            res.push_back(rem % any);
+            rem /= any;
+        }
     }
+    while (res.size() > 1 && res.back() == 0) res.pop_back();
     return res;
 }
 
 ll mpow(ll a, ll st) {
+    Stage_timer timer(MPOW);
+    OP_SCOPE("mpow");
     if (st == 0) return 1;
     ll res = mpow(a, st / 2);
     res = (res * res) % p;
-    if (st % 2) res = (res * a) % p;
+    COUNT_OP(SQR), COUNT_OP(RED);
+    if (st % 2) res = (res * a) % p, COUNT_OP(MUL), COUNT_OP(RED);
     return res;
 }
 
@@ -165,9 +522,203 @@ vector<ll> convert_to_mes(std::string& str) {
 }
 
 ll rev(ll num) {
+    Stage_timer timer(REV);
+    OP_SCOPE("rev");
+    COUNT_OP(INV);
     return mpow(num, p - 2);
 }
 
+// Montgomery arithmetic mod an odd multi-limb modulus (R = 2^(64 * n)) for
+// p >= 2^32. Elements are n limbs in Montgomery form; multiplying one by a
+// plain value gives the plain product, so results leave the form for free.
+constexpr int max_limbs = 64;
+
+class Mont {
+    public:
+    int n;
+    Number mod;
+    vector<ll> m, r2, one; // p, R^2 and R mod p
+    ll m_inv; // -p^-1 mod 2^64
+
+    explicit Mont(const Number& mod) : n((int)mod.limbs().size()), mod(mod), m(mod.limbs()) {
+        ll inv = m[0];
+        for (int i = 0; i < 6; ++i) inv *= 2 - m[0] * inv;
+        m_inv = 0 - inv;
+        vector<ll> r(2 * n + 1);
+        r[2 * n] = 1;
+        r2 = padded(Number(move(r)).divmod(mod));
+        one = to(Number(1));
+    }
+
+    vector<ll> padded(const Number& a) const {
+        vector<ll> res = a.limbs();
+        res.resize(n);
+        return res;
+    }
+
+    // r = a * b / R mod p, r may alias a or b. Product scanning: column k
+    // sums a[i] * b[k - i] and q[i] * m[k - i] in a three-word accumulator,
+    // and q[k] is chosen so that the low word of column k cancels.
+    void mul(ll* r, const ll* a, const ll* b) const {
+        COUNT_OP(MUL);
+        columns<false>(r, a, b);
+    }
+
+    // r = a^2 / R mod p, every cross product is computed once and doubled
+    void sqr(ll* r, const ll* a) const {
+        COUNT_OP(SQR);
+        columns<true>(r, a, a);
+    }
+
+    static inline void mac(unsigned __int128& acc, ll& top, ll x, ll y) {
+        unsigned __int128 prod = (unsigned __int128)x * y;
+        acc += prod;
+        top += acc < prod;
+    }
+
+    // adds column k of a * b (lo <= i <= hi) to the accumulator
+    template<bool square>
+    static inline void column(unsigned __int128& acc, ll& top, const ll* a, const ll* b, int k, int lo, int hi) {
+        if (!square) {
+            for (int i = lo; i <= hi; ++i) mac(acc, top, a[i], b[k - i]);
+            return;
+        }
+        unsigned __int128 cross = 0;
+        ll cross_top = 0;
+        for (int i = lo; i < k - i; ++i) mac(cross, cross_top, a[i], a[k - i]);
+        cross_top = cross_top << 1 | (ll)(cross >> 127);
+        cross <<= 1;
+        acc += cross;
+        top += cross_top + (acc < cross);
+        if (k % 2 == 0) mac(acc, top, a[k / 2], a[k / 2]);
+    }
+
+    template<bool square>
+    void columns(ll* r, const ll* a, const ll* b) const {
+        ll q[max_limbs], t[max_limbs];
+        const ll* m = this->m.data();
+        unsigned __int128 acc = 0;
+        ll top = 0;
+        for (int k = 0; k < n; ++k) {
+            column<square>(acc, top, a, b, k, 0, k);
+            for (int i = 0; i < k; ++i) mac(acc, top, q[i], m[k - i]);
+            q[k] = (ll)acc * m_inv;
+            mac(acc, top, q[k], m[0]);
+            acc = acc >> 64 | (unsigned __int128)top << 64;
+            top = 0;
+        }
+        for (int k = n; k < 2 * n - 1; ++k) {
+            column<square>(acc, top, a, b, k, k - n + 1, n - 1);
+            for (int i = k - n + 1; i < n; ++i) mac(acc, top, q[i], m[k - i]);
+            t[k - n] = (ll)acc;
+            acc = acc >> 64 | (unsigned __int128)top << 64;
+            top = 0;
+        }
+        t[n - 1] = (ll)acc;
+        // t < 2p
+        ll d[max_limbs], borrow = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 cur = (unsigned __int128)t[i] - m[i] - borrow;
+            d[i] = (ll)cur;
+            borrow = (ll)(cur >> 64) & 1;
+        }
+        memcpy(r, (ll)(acc >> 64) || !borrow ? d : t, n * sizeof(ll));
+    }
+
+    vector<ll> to(Number a) const {
+        if (!(mod > a)) a = a.divmod(mod);
+        vector<ll> res = padded(a);
+        mul(res.data(), res.data(), r2.data());
+        return res;
+    }
+
+    Number from(const vector<ll>& a) const {
+        vector<ll> res(n), plain(n);
+        plain[0] = 1;
+        mul(res.data(), a.data(), plain.data());
+        return Number(move(res));
+    }
+
+    // a^e for a in Montgomery form: sliding window over the odd powers a^1, a^3, ..., a^(2^w - 1)
+    vector<ll> pow(const vector<ll>& a, const Number& e) const {
+        Stage_timer timer(MPOW);
+        OP_SCOPE("mpow");
+        int bits = e.bits();
+        int w = bits > 1024 ? 6 : bits > 256 ? 5 : bits > 64 ? 4 : 2;
+        vector<vector<ll>> odd(1 << (w - 1), a);
+        vector<ll> a2(n);
+        sqr(a2.data(), a.data());
+        for (size_t i = 1; i < odd.size(); ++i) mul(odd[i].data(), odd[i - 1].data(), a2.data());
+        vector<ll> res = one;
+        bool started = false;
+        for (int i = bits - 1; i >= 0;) {
+            if (!e.bit(i)) {
+                if (started) sqr(res.data(), res.data());
+                --i;
+                continue;
+            }
+            int j = max(i - w + 1, 0);
+            while (!e.bit(j)) ++j;
+            int digit = 0;
+            for (int k = i; k >= j; --k) {
+                digit = digit << 1 | e.bit(k);
+                if (started) sqr(res.data(), res.data());
+            }
+            if (started) mul(res.data(), res.data(), odd[digit >> 1].data());
+            else res = odd[digit >> 1], started = true;
+            i = j - 1;
+        }
+        return res;
+    }
+};
+
+// Lane-parallel Montgomery arithmetic mod p < 2^31 (R = 2^32) for batches of
+// independent blocks. Every operation is a loop over the lanes, which the
+// avx2 clones below turn into AVX2 code.
+constexpr int lane_count = 8;
+uint64_t lane_p, lane_pinv; // -p^-1 mod 2^32
+uint64_t lane_one[lane_count], lane_r2[lane_count]; // R and R^2 mod p
+
+#define LANE_INLINE inline __attribute__((always_inline))
+
+bool lane_init() {
+    if (p >= (1LL << 31) || p % 2 == 0) return false;
+    uint32_t inv = p;
+    for (int i = 0; i < 4; ++i) inv *= 2 - (uint32_t)p * inv;
+    lane_p = p, lane_pinv = (uint32_t)-inv;
+    ll r = (1LL << 32) % p;
+    for (int l = 0; l < lane_count; ++l)
+        lane_one[l] = r, lane_r2[l] = r * r % p;
+    return true;
+}
+
+// r = a * b / R mod p for a, b < p
+LANE_INLINE void lane_mul(uint64_t* r, const uint64_t* a, const uint64_t* b) {
+    COUNT_OP_N(a == b ? SQR : MUL, lane_count), COUNT_OP_N(RED, lane_count);
+    for (int l = 0; l < lane_count; ++l) {
+        uint64_t t = (a[l] & 0xffffffff) * (b[l] & 0xffffffff);
+        uint64_t m = ((t & 0xffffffff) * lane_pinv) & 0xffffffff;
+        uint64_t u = (t + m * lane_p) >> 32;
+        r[l] = u >= lane_p ? u - lane_p : u;
+    }
+}
+
+// res[l] = base[l]^st * factor[l] for one exponent st shared by all lanes
+__attribute__((target_clones("avx2", "default")))
+void lane_mpow(uint64_t* res, const uint64_t* base, ll st, const uint64_t* factor) {
+    OP_SCOPE("batch_mpow");
+    uint64_t x[lane_count], acc[lane_count];
+    lane_mul(x, base, lane_r2);
+    for (int l = 0; l < lane_count; ++l)
+        acc[l] = lane_one[l];
+    for (int i = 63; i >= 0; --i) {
+        if (st >> i == 0) continue;
+        lane_mul(acc, acc, acc);
+        if (st >> i & 1) lane_mul(acc, acc, x);
+    }
+    lane_mul(res, acc, factor);
+}
+
 void Ell_Gamal_coding(vector<ll> mes, ll g, ll k) {
     for (auto num : mes) {
         ll st = rand() % (p - 1) + 1;
@@ -175,21 +726,162 @@ void Ell_Gamal_coding(vector<ll> mes, ll g, ll k) {
     }
 }
 
-int main() {
+template<typename T>
+bool read_block(T& r, T& m) {
+    Stage_timer timer(PARSE);
+    return (bool)(cin >> r >> m);
+}
+
+// m * r^-a for every block, r^-a == r^(p-1-a) so one exponentiation per block instead of mpow and rev
+vector<ll> Ell_Gamal_encoding(const vector<ll>& rs, const vector<ll>& ms, ll e) {
+    vector<ll> mes(rs.size());
+    int i = 0;
+    if (lane_init()) {
+        Stage_timer timer(MPOW);
+        uint64_t base[lane_count], factor[lane_count], res[lane_count];
+        for (; i + lane_count <= rs.size(); i += lane_count) {
+            Message_timer message(lane_count);
+            OP_SCOPE("block", lane_count);
+            for (int l = 0; l < lane_count; ++l)
+                base[l] = rs[i + l], factor[l] = ms[i + l];
+            lane_mpow(res, base, e, factor);
+            for (int l = 0; l < lane_count; ++l)
+                mes[i + l] = res[l];
+        }
+    }
+    for (; i < rs.size(); ++i) {
+        Message_timer message;
+        OP_SCOPE("block");
+        mes[i] = ms[i] * mpow(rs[i], e) % p;
+        COUNT_OP(MUL), COUNT_OP(RED);
+    }
+    return mes;
+}
+
+void print_text(vector<ll> mes, size_t chars) {
+    auto res = from_10_to_any(from_any_to_10(mes, p), 64);
+    // characters with value 0 at the end of a frame are not in the number
+    if (res.size() < chars) res.resize(chars, 0);
+    Stage_timer output(OUTPUT);
+    for (auto el : res) {
+        cout << number_to_char(el);
+    }
+}
+
+// blocks for p < 2^32, decrypted by Ell_Gamal_encoding above
+struct Zp_key {
+    typedef ll block;
+    ll e;
+
+    void reduce(ll& x) const { x %= p; }
+    vector<ll> decode(const vector<ll>& rs, const vector<ll>& ms) const { return Ell_Gamal_encoding(rs, ms, e); }
+    void print(vector<ll> mes, size_t chars) const { print_text(move(mes), chars); }
+};
+
+// blocks for p >= 2^32: m * r^e with the same e = p - 1 - a as above
+struct Big_key {
+    typedef Number block;
+    const Mont& mont;
+    Number e;
+
+    void reduce(Number& x) const {
+        if (!(mont.mod > x)) x = x.divmod(mont.mod);
+    }
+
+    vector<Number> decode(const vector<Number>& rs, const vector<Number>& ms) const {
+        vector<Number> mes(rs.size());
+        for (size_t i = 0; i < rs.size(); ++i) {
+            Message_timer message;
+            OP_SCOPE("block");
+            auto s = mont.pow(mont.to(rs[i]), e);
+            auto plain = mont.padded(ms[i]);
+            mont.mul(s.data(), s.data(), plain.data());
+            mes[i] = Number(move(s));
+        }
+        return mes;
+    }
+
+    void print(const vector<Number>& mes, size_t chars) const {
+        Number num;
+        {
+            Stage_timer timer(RADIX);
+            OP_SCOPE("from_p_to_10");
+            for (auto it = mes.rbegin(); it != mes.rend(); ++it) num = num * mont.mod + *it;
+        }
+        auto res = from_10_to_any(num, 64);
+        if (res.size() < chars) res.resize(chars, 0);
+        Stage_timer output(OUTPUT);
+        for (auto el : res) {
+            cout << number_to_char(el);
+        }
+    }
+};
+
+// --stream / --batch: frames "<chars> <blocks>" written by the encryptor's
+// --stream or --batch, every frame is decrypted and printed on its own;
+// with --batch each frame is a separate message ending with a newline
+template<typename Key>
+void stream_decoding(const Key& key, bool batch) {
+    size_t chars, blocks;
+    vector<typename Key::block> rs, ms;
+    while (true) {
+        Stage_timer parse(PARSE);
+        if (!(cin >> chars >> blocks)) break;
+        rs.resize(blocks), ms.resize(blocks);
+        for (size_t i = 0; i < blocks; ++i) {
+            cin >> rs[i] >> ms[i];
+            key.reduce(rs[i]), key.reduce(ms[i]);
+        }
+        parse.stop();
+        if (blocks) key.print(key.decode(rs, ms), chars);
+        if (batch) cout << '\n';
+        cout.flush();
+    }
+}
+
+template<typename Key>
+int decoding(const Key& key, bool stream, bool batch) {
+    if (stream) {
+        stream_decoding(key, batch);
+        return 0;
+    }
+    typename Key::block r, m;
+    vector<typename Key::block> rs, ms;
+    while (read_block(r, m)) {
+        key.reduce(r), key.reduce(m);
+        rs.push_back(r), ms.push_back(m);
+    }
+    key.print(key.decode(rs, ms), 0);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     srand(time(NULL));
+    bool stream = false, batch = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--stream") stream = true;
+        if (arg == "--batch") batch = true;
+        if (arg == "--stats") stats.enabled = true;
+        if (arg == "--stats-json" && i + 1 < argc) stats.enabled = true, stats.json_path = argv[++i];
+    }
     ios_base::sync_with_stdio(false);
     cin.tie(NULL);
     cout.tie(NULL);
-    ll a; cin >> p >> a;
+    Stage_timer parse(PARSE);
+    Number big_p, big_a;
+    cin >> big_p >> big_a;
     cin.get();
-    ll r, m;
-    vector<ll> mes;
-    while (cin >> r >> m) {
-        ll k = mpow(r, a);
-        mes.push_back(m * rev(k) % p);
-    }
-    auto res = from_10_to_any(from_any_to_10(mes, p), 64);
-    for (auto el : res) {
-        cout << number_to_char(el);
+    parse.stop();
+    if (big_p.bits() > 32) {
+        if (!big_p.bit(0) || big_p.limbs().size() > max_limbs) {
+            cerr << "p must be odd and below 2^" << 64 * max_limbs << '\n';
+            return 1;
+        }
+        Mont mont(big_p);
+        Number order = big_p - Number(1);
+        return decoding(Big_key{ mont, order - big_a.divmod(order) }, stream || batch, batch);
     }
+    p = big_p[0];
+    return decoding(Zp_key{ p - 1 - big_a % (p - 1) }, stream || batch, batch);
 }
\ No newline at end of file
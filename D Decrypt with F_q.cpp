@@ -1,94 +1,303 @@
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <time.h>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 typedef unsigned long long ll;
 ll p;
-int sz = 7;
-ll max_rank = 10'000'000;
 vector <long long> h;
+// nonzero terms of x^n = sum of h[i] x^i, found by main once h is normalized;
+// reduction touches only these, and a binomial x^n - c has just one
+vector<pair<int, ll>> h_terms;
+bool h_binomial = false;
 
+// --stats: cumulative time per stage and per-message latency percentiles,
+// printed to stderr at exit; --stats-json <file> writes them as JSON instead.
+// Stages nest (e.g. mpow inside rev), so their times overlap.
+enum Stage { PARSE, RADIX, MPOW, REV, OUTPUT, STAGES };
+const char* stage_names[STAGES] = { "parse", "radix", "mpow", "rev", "output" };
+
+struct Stats {
+    static constexpr int buckets = 256; // 4 buckets per power of two nanoseconds
+    bool enabled = false;
+    string json_path;
+    atomic<long long> stage_ns[STAGES] = {};
+    atomic<long long> latency[buckets] = {};
+    atomic<long long> messages{ 0 }, max_latency{ 0 };
+
+    static long long now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void add_latency(long long ns) {
+        int bucket = ns > 1 ? min(buckets - 1, (int)(4 * log2((double)ns))) : 0;
+        ++latency[bucket];
+        ++messages;
+        long long cur = max_latency;
+        while (ns > cur && !max_latency.compare_exchange_weak(cur, ns));
+    }
+
+    // upper bound of the bucket holding the q-th quantile, in microseconds
+    double percentile(double q) const {
+        long long need = max(1LL, (long long)ceil(q * messages)), seen = 0;
+        for (int i = 0; i < buckets; ++i) {
+            seen += latency[i];
+            if (seen >= need) return min(exp2((i + 1) / 4.0), (double)max_latency) / 1e3;
+        }
+        return max_latency / 1e3;
+    }
+
+    void report() const {
+        const double qs[] = { 0.5, 0.9, 0.99 };
+        const char* names[] = { "p50", "p90", "p99" };
+        if (json_path.empty()) {
+            cerr << "stage     total_ms\n";
+            for (int i = 0; i < STAGES; ++i)
+                cerr << left << setw(10) << stage_names[i] << stage_ns[i] / 1e6 << '\n';
+            cerr << "latency_us messages=" << messages;
+            for (int i = 0; i < 3; ++i)
+                cerr << ' ' << names[i] << '=' << (messages ? percentile(qs[i]) : 0);
+            cerr << " max=" << max_latency / 1e3 << '\n';
+            return;
+        }
+        ofstream os(json_path);
+        os << "{\"stages_ms\": {";
+        for (int i = 0; i < STAGES; ++i)
+            os << (i ? ", " : "") << '"' << stage_names[i] << "\": " << stage_ns[i] / 1e6;
+        os << "}, \"latency_us\": {\"messages\": " << messages;
+        for (int i = 0; i < 3; ++i)
+            os << ", \"" << names[i] << "\": " << (messages ? percentile(qs[i]) : 0);
+        os << ", \"max\": " << max_latency / 1e3 << "}}\n";
+    }
+
+    ~Stats() {
+        if (enabled) report();
+    }
+} stats;
+
+// Instrumentation build (-DCOUNT_OPS): counts arithmetic operations and heap
+// allocations per high-level operation and prints them to stderr at exit.
+#ifdef COUNT_OPS
+enum Op_kind { MUL, SQR, RED, DIV, INV, ALLOC, OP_KINDS };
+const char* op_kind_names[OP_KINDS] = { "mul", "sqr", "reduce", "div", "inv", "alloc" };
+thread_local long long op_count[OP_KINDS];
+thread_local const char* op_stack[32];
+thread_local int op_depth;
+
+struct Op_report {
+    struct Totals {
+        long long calls = 0;
+        long long count[OP_KINDS] = {};
+    };
+    mutex mtx;
+    map<string, Totals> ops;
+
+    ~Op_report() {
+        cerr << left << setw(20) << "op" << setw(10) << "calls";
+        for (auto name : op_kind_names)
+            cerr << setw(12) << name;
+        cerr << "(per call)\n";
+        for (auto& [name, t] : ops) {
+            cerr << setw(20) << name << setw(10) << t.calls;
+            for (auto c : t.count)
+                cerr << setw(12) << (double)c / t.calls;
+            cerr << '\n';
+        }
+    }
+} op_report;
+
+// only the outermost scope of a name is counted, so recursion is one call
+class Op_scope {
+    const char* name = nullptr;
+    long long start[OP_KINDS];
+    public:
+    explicit Op_scope(const char* name) {
+        for (int i = 0; i < op_depth; ++i)
+            if (op_stack[i] == name) return;
+        this->name = name;
+        op_stack[op_depth++] = name;
+        copy(op_count, op_count + OP_KINDS, start);
+    }
+    ~Op_scope() {
+        if (!name) return;
+        --op_depth;
+        long long delta[OP_KINDS];
+        for (int i = 0; i < OP_KINDS; ++i)
+            delta[i] = op_count[i] - start[i];
+        lock_guard<mutex> lock(op_report.mtx);
+        auto& t = op_report.ops[name];
+        ++t.calls;
+        for (int i = 0; i < OP_KINDS; ++i)
+            t.count[i] += delta[i];
+    }
+};
+
+// the replacements pair malloc with free, gcc only sees new paired with free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t n) {
+    ++op_count[ALLOC];
+    if (void* ptr = malloc(n ? n : 1)) return ptr;
+    throw bad_alloc();
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+#pragma GCC diagnostic pop
+
+#define COUNT_OP(kind) (++op_count[kind])
+#define OP_SCOPE(name) Op_scope op_scope_(name)
+#else
+#define COUNT_OP(kind) ((void)0)
+#define OP_SCOPE(name) ((void)0)
+#endif
+
+thread_local int stage_depth[STAGES];
+
+// only the outermost timer of a stage on each thread is counted
+class Stage_timer {
+    Stage stage;
+    bool running;
+    long long start = 0;
+    public:
+    explicit Stage_timer(Stage stage) : stage(stage), running(stats.enabled) {
+        if (running && stage_depth[stage]++ == 0) start = Stats::now();
+    }
+    void stop() {
+        if (!running) return;
+        running = false;
+        if (--stage_depth[stage] == 0) stats.stage_ns[stage] += Stats::now() - start;
+    }
+    ~Stage_timer() { stop(); }
+};
+
+class Message_timer {
+    long long start = 0;
+    public:
+    Message_timer() {
+        if (stats.enabled) start = Stats::now();
+    }
+    ~Message_timer() {
+        if (stats.enabled) stats.add_latency(Stats::now() - start);
+    }
+};
+
+// Non-negative integer on 64-bit binary limbs, least significant first.
+// Zero is the empty vector.
 class Number {
     vector<ll> val;
+
+    void trim() {
+        while (!val.empty() && val.back() == 0) val.pop_back();
+    }
+
     public:
-    Number(ll num) : val({ num }) {}
-    Number(vector<ll> mas) : val(mas) {}
+    Number(ll num = 0) {
+        if (num) val.push_back(num);
+    }
+    Number(vector<ll> mas) : val(move(mas)) { trim(); }
+
+    Number& operator+=(const Number& other) {
+        if (val.size() < other.val.size()) val.resize(other.val.size());
+        ll carry = 0;
+        for (size_t i = 0; i < val.size() && (carry || i < other.val.size()); ++i) {
+            unsigned __int128 cur = (unsigned __int128)val[i] + other[i] + carry;
+            val[i] = (ll)cur;
+            carry = (ll)(cur >> 64);
+        }
+        if (carry) val.push_back(carry);
+        return *this;
+    }
     Number operator+ (const Number& other) const {
-        vector<ll> res(max(other.val.size(), this->val.size()) + 1);
-        for (int i = 0; i + 1 < res.size(); ++i) {
-            res[i] += (*this)[i] + other[i];
-            if (res[i] >= max_rank) {
-                ++res[i + 1];
-                res[i] -= max_rank;
-            }
+        return Number(*this) += other;
+    }
+    Number& operator*=(const ll d) {
+        COUNT_OP(MUL);
+        ll carry = 0;
+        for (auto& el : val) {
+            unsigned __int128 cur = (unsigned __int128)el * d + carry;
+            el = (ll)cur;
+            carry = (ll)(cur >> 64);
         }
-        while (res.size() > 1 && res.back() == 0) res.pop_back();
-        return Number(res);
+        if (carry) val.push_back(carry);
+        trim();
+        return *this;
     }
     Number operator* (const Number& other) const {
+        COUNT_OP(&other == this ? SQR : MUL);
         vector<ll> res(other.val.size() + this->val.size());
-        for (int i = 0; i < this->val.size(); ++i) {
-            for (int j = 0; j < other.val.size(); ++j) {
-                res[i + j] += this->val[i] * other.val[j];
-                int ind = i + j;
-                while (res[ind] >= max_rank) {
-                    if (ind + 1 == res.size()) {
-                        res.push_back(0);
-                    }
-                    res[ind + 1] += res[ind] / max_rank;
-                    res[ind] %= max_rank;
-                    ++ind;
-                }
+        for (size_t i = 0; i < this->val.size(); ++i) {
+            ll carry = 0;
+            for (size_t j = 0; j < other.val.size(); ++j) {
+                unsigned __int128 cur = (unsigned __int128)this->val[i] * other.val[j] + res[i + j] + carry;
+                res[i + j] = (ll)cur;
+                carry = (ll)(cur >> 64);
             }
+            res[i + other.val.size()] = carry;
         }
-        while (res.size() != 0 && res.back() == 0) res.pop_back();
-        if (res.size() == 0)res = { 0 };
-        return Number(res);
+        return Number(move(res));
+    }
+    Number& operator*=(const Number& other) {
+        return *this = *this * other;
     }
     bool operator==(const Number& other) const {
-        if (this->val.size() != other.val.size()) {
-            return false;
-        }
-        for (int i = this->val.size() - 1; i >= 0; --i) {
-            if (this->val[i] != other.val[i]) {
-                return false;
-            }
-        }
-        return true;
+        return this->val == other.val;
     }
     bool operator>(const Number& other) const {
         if (this->val.size() != other.val.size()) {
             return this->val.size() > other.val.size();
         }
-        for (int i = this->val.size() - 1; i >= 0; --i) {
+        for (int i = (int)this->val.size() - 1; i >= 0; --i) {
             if (this->val[i] != other.val[i]) {
                 return this->val[i] > other.val[i];
             }
         }
         return false;
     }
+    bool isZero() const {
+        return val.empty();
+    }
 
-    Number operator/=(const ll d) {
-        for (int i = val.size() - 1; i > 0; --i) {
-            val[i - 1] += val[i] % d * max_rank;
-            val[i] /= d;
+    // divides in place and returns the remainder in one pass
+    ll divmod_small(const ll d) {
+        COUNT_OP(DIV);
+        unsigned __int128 rem = 0;
+        for (int i = (int)val.size() - 1; i >= 0; --i) {
+            unsigned __int128 cur = rem << 64 | val[i];
+            val[i] = (ll)(cur / d);
+            rem = cur % d;
         }
-        val[0] /= d;
-        while (val.size() != 0 && val.back() == 0) val.pop_back();
-        if (val.size() == 0)val = { 0 };
+        trim();
+        return (ll)rem;
+    }
+
+    Number& operator/=(const ll d) {
+        divmod_small(d);
         return *this;
     }
 
     ll operator%(const ll d) const {
-        vector<ll> val = this->val;
-        for (int i = val.size() - 1; i > 0; --i) {
-            val[i - 1] += val[i] % d * max_rank;
-            val[i] /= d;
+        COUNT_OP(RED);
+        unsigned __int128 rem = 0;
+        for (int i = (int)val.size() - 1; i >= 0; --i) {
+            rem = (rem << 64 | val[i]) % d;
         }
-        return val[0] % d;
+        return (ll)rem;
     }
 
     ll operator[] (int i) const {
@@ -99,24 +308,137 @@ class Number {
     }
 };
 
+// largest power of any that fits into a limb, and its exponent
+pair<ll, int> limb_power(ll any) {
+    ll chunk = any;
+    int k = 1;
+    while (chunk <= ~0ULL / any) chunk *= any, ++k;
+    return { chunk, k };
+}
+
+
+// Per-thread bump allocator for arithmetic temporaries. While an
+// Arena_scope is open, Polinom coefficients come from the thread's arena and
+// frees are no-ops; the outermost scope releases everything in O(1).
+// Values that outlive the scope must leave it through Arena_scope::keep;
+// -DARENA_CHECK aborts when an arena pointer is freed after its scope ended.
+class Arena {
+    struct Block {
+        char* mem;
+        size_t size;
+    };
+    vector<Block> blocks;
+    size_t block = 0, used = 0;
+
+    public:
+    int depth = 0;
+    bool paused = false;
+    size_t generation = 0; // bumped by every reset
+
+    ~Arena() {
+#ifndef ARENA_CHECK // the checks still read headers of late frees
+        for (auto& b : blocks) free(b.mem);
+#endif
+    }
+
+    bool active() const { return depth > 0 && !paused; }
+
+    void* allocate(size_t n) {
+        n = (n + 15) & ~(size_t)15;
+        while (block < blocks.size() && used + n > blocks[block].size) ++block, used = 0;
+        if (block == blocks.size()) {
+            size_t size = max(n, (size_t)1 << 20);
+            blocks.push_back({ (char*)malloc(size), size });
+            used = 0;
+        }
+        void* ptr = blocks[block].mem + used;
+        used += n;
+        return ptr;
+    }
+
+    void reset() { block = 0, used = 0, ++generation; }
+};
+
+thread_local Arena arena;
+
+// Every allocation starts with a header saying where it came from, so a free
+// never asks the arena, which is destroyed before global values are.
+struct Arena_header {
+    const Arena* owner; // nullptr for the heap
+    size_t generation;
+};
+
+void* arena_allocate(size_t n) {
+    bool active = arena.active();
+    n += sizeof(Arena_header);
+    auto* header = (Arena_header*)(active ? arena.allocate(n) : ::operator new(n));
+    *header = { active ? &arena : nullptr, arena.generation };
+    return header + 1;
+}
+
+void arena_deallocate(void* ptr) {
+    if (!ptr) return;
+    auto* header = (Arena_header*)ptr - 1;
+#ifdef ARENA_CHECK
+    if (header->owner && (header->owner != &arena || header->generation != arena.generation)) {
+        cerr << "arena pointer escaped its Arena_scope\n";
+        abort();
+    }
+#endif
+    if (!header->owner) ::operator delete(header);
+}
+
+class Arena_scope {
+    public:
+    Arena_scope() { ++arena.depth; }
+    ~Arena_scope() {
+        if (--arena.depth == 0) arena.reset();
+    }
+    Arena_scope(const Arena_scope&) = delete;
+
+    // copies the result to the heap when it leaves the outermost scope
+    template<typename T>
+    T keep(const T& value) {
+        if (arena.depth > 1) return value;
+        arena.paused = true;
+        T res(value);
+        arena.paused = false;
+        return res;
+    }
+};
+
+template<typename T>
+struct Arena_allocator {
+    using value_type = T;
+    Arena_allocator() = default;
+    template<typename U>
+    Arena_allocator(const Arena_allocator<U>&) {}
+    T* allocate(size_t n) { return (T*)arena_allocate(n * sizeof(T)); }
+    void deallocate(T* ptr, size_t) { arena_deallocate(ptr); }
+    bool operator==(const Arena_allocator&) const { return true; }
+    bool operator!=(const Arena_allocator&) const { return false; }
+};
+
+typedef vector<ll, Arena_allocator<ll>> Coeffs;
 
 class Polinom {
-    vector<ll> val;
+    Coeffs val;
     public:
     Polinom() {}
     Polinom(ll num) : val({ num }) {}
-    Polinom(vector<ll> mas) : val(mas) {}
+    Polinom(const vector<ll>& mas) : val(mas.begin(), mas.end()) {}
+    Polinom(Coeffs mas) : val(move(mas)) {}
     Polinom operator+ (const Polinom& other) const {
-        vector<ll> res(max(other.val.size(), this->val.size()) + 1);
-        for (int i = 0; i + 1 < res.size(); ++i) {
-            res[i] += ((*this)[i] + other[i]) % p;
-            res[i] %= p;
+        Coeffs res(max(other.val.size(), this->val.size()));
+        for (int i = 0; i < res.size(); ++i) {
+            res[i] = ((*this)[i] + other[i]) % p;
         }
         while (res.size() > 1 && res.back() == 0) res.pop_back();
-        return Polinom(res);
+        return Polinom(move(res));
     }
     Polinom operator* (const Polinom& other) const {
-        vector<ll> res(other.val.size() + this->val.size());
+        COUNT_OP(&other == this ? SQR : MUL);
+        Coeffs res(other.val.size() + this->val.size());
         for (int i = 0; i < this->val.size(); ++i) {
             for (int j = 0; j < other.val.size(); ++j) {
                 res[i + j] += (this->val[i] * other.val[j]) % p;
@@ -126,13 +448,19 @@ class Polinom {
         this->get_mod(res);
         while (res.size() != 0 && res.back() == 0) res.pop_back();
         if (res.size() == 0)res = { 0 };
-        return Polinom(res);
+        return Polinom(move(res));
     }
     bool operator==(const Polinom& other) const {
-        return Number(this->val) == Number(other.val);
+        for (int i = 0; i < max(val.size(), other.val.size()); ++i) {
+            if ((*this)[i] != other[i]) return false;
+        }
+        return true;
     }
     bool operator>(const Polinom& other) const {
-        return Number(this->val) > Number(other.val);
+        for (int i = (int)max(val.size(), other.val.size()) - 1; i >= 0; --i) {
+            if ((*this)[i] != other[i]) return (*this)[i] > other[i];
+        }
+        return false;
     }
 
     ll operator[] (int i) const {
@@ -142,10 +470,10 @@ class Polinom {
         return this->val[i];
     }
 
-    vector<ll>::const_iterator begin() const {
+    Coeffs::const_iterator begin() const {
         return val.begin();
     }
-    vector<ll>::const_iterator end() const {
+    Coeffs::const_iterator end() const {
         return val.end();
     }
 
@@ -154,12 +482,21 @@ class Polinom {
     }
 
     private:
-    void get_mod(vector<ll>& mas) const {
-        for (int i = mas.size() - 1; i >= 0; --i) {
-            if (i + 1 < h.size()) break;
-            for (int j = 0; j + 1 < h.size(); ++j) {
-                mas[i + j + 1 - h.size()] += mas[i] * h[j] % p;
-                mas[i + j + 1 - h.size()] %= p;
+    void get_mod(Coeffs& mas) const {
+        COUNT_OP(RED);
+        int n = h.size() - 1;
+        if (h_binomial) {
+            ll c = h_terms[0].second;
+            for (int i = (int)mas.size() - 1; i >= n; --i) {
+                mas[i - n] = (mas[i - n] + mas[i] * c) % p;
+                mas[i] = 0;
+            }
+            return;
+        }
+        for (int i = (int)mas.size() - 1; i >= n; --i) {
+            if (!mas[i]) continue;
+            for (auto [j, c] : h_terms) {
+                mas[i + j - n] = (mas[i + j - n] + mas[i] * c) % p;
             }
             mas[i] = 0;
         }
@@ -174,6 +511,177 @@ ostream& operator<<(ostream& os, const Polinom& poly)
     return os;
 }
 
+// GF(2^m) for p == 2: coefficients are packed 64 to a word. Products are
+// carry-less (PCLMULQDQ when the CPU has it), squares spread the bits of each
+// word apart, and reduction folds whole words through the nonzero terms of h
+// only, so a trinomial or pentanomial costs a few shifts per word.
+class Gf2 {
+    public:
+    static constexpr int max_words = 16;
+    static int m, n; // degree of h and words per element
+    static vector<int> taps; // x^m = sum of x^t over the taps
+    static void (*mul_words)(const uint64_t* a, const uint64_t* b, uint64_t* res);
+    static uint16_t spread[256];
+
+    uint64_t val[max_words] = {};
+
+    Gf2() {}
+    Gf2(ll num) { val[0] = num & 1; }
+    Gf2(const vector<ll>& mas) {
+        vector<uint64_t> res(max((mas.size() + 63) / 64, (size_t)n));
+        for (size_t i = 0; i < mas.size(); ++i) res[i / 64] |= (uint64_t)(mas[i] & 1) << i % 64;
+        reduce(res.data(), res.size());
+        copy(res.begin(), res.begin() + n, val);
+    }
+
+    // 2 <= deg h <= 64 * max_words, checked by main
+    static void init() {
+        m = (int)h.size() - 1;
+        n = (m + 63) / 64;
+        for (int i = 0; i < m; ++i)
+            if (h[i]) taps.push_back(i);
+        for (int i = 0; i < 256; ++i)
+            for (int j = 0; j < 8; ++j) spread[i] |= (i >> j & 1) << 2 * j;
+        mul_words = mul_shift;
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("pclmul")) mul_words = mul_clmul;
+#endif
+    }
+
+    Gf2 operator+ (const Gf2& other) const {
+        Gf2 res;
+        for (int i = 0; i < n; ++i) res.val[i] = val[i] ^ other.val[i];
+        return res;
+    }
+    Gf2 operator* (const Gf2& other) const {
+        if (&other == this) return sqr();
+        COUNT_OP(MUL);
+        uint64_t res[2 * max_words] = {};
+        mul_words(val, other.val, res);
+        return reduced(res);
+    }
+    Gf2 sqr() const {
+        COUNT_OP(SQR);
+        uint64_t res[2 * max_words];
+        for (int i = 0; i < n; ++i) {
+            uint64_t w = val[i];
+            res[2 * i] = spread_word(w);
+            res[2 * i + 1] = spread_word(w >> 32);
+        }
+        return reduced(res);
+    }
+
+    // a^(2^m - 2) by Itoh-Tsujii: b_k = a^(2^k - 1) doubles k along the bits
+    // of m - 1, which takes m - 1 squarings and about log2(m) multiplications
+    Gf2 inv() const {
+        COUNT_OP(INV);
+        Gf2 b = *this;
+        int k = 1;
+        for (int i = 30 - __builtin_clz((m - 1) | 1); i >= 0; --i) {
+            Gf2 t = b;
+            for (int j = 0; j < k; ++j) t = t.sqr();
+            b = t * b, k *= 2;
+            if ((m - 1) >> i & 1) b = b.sqr() * *this, ++k;
+        }
+        return b.sqr();
+    }
+
+    bool operator==(const Gf2& other) const {
+        return equal(val, val + n, other.val);
+    }
+
+    ll operator[] (int i) const {
+        return i < m ? val[i / 64] >> i % 64 & 1 : 0;
+    }
+
+    // index of the highest nonzero coefficient plus one, at least 1
+    size_t size() const {
+        for (int i = n - 1; i >= 0; --i)
+            if (val[i]) return 64 * i + 64 - __builtin_clzll(val[i]);
+        return 1;
+    }
+
+    private:
+    static uint64_t spread_word(uint64_t w) {
+        return (uint64_t)spread[w & 255] | (uint64_t)spread[w >> 8 & 255] << 16
+            | (uint64_t)spread[w >> 16 & 255] << 32 | (uint64_t)spread[w >> 24 & 255] << 48;
+    }
+
+    static void mul_shift(const uint64_t* a, const uint64_t* b, uint64_t* res) {
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                uint64_t lo = 0, hi = 0, x = a[i], y = b[j];
+                for (int k = 0; k < 64; ++k) {
+                    uint64_t mask = -(y >> k & 1);
+                    lo ^= x << k & mask;
+                    if (k) hi ^= x >> (64 - k) & mask;
+                }
+                res[i + j] ^= lo;
+                res[i + j + 1] ^= hi;
+            }
+        }
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("pclmul"))) static void mul_clmul(const uint64_t* a, const uint64_t* b, uint64_t* res) {
+        for (int i = 0; i < n; ++i) {
+            __m128i x = _mm_cvtsi64_si128(a[i]);
+            for (int j = 0; j < n; ++j) {
+                __m128i t = _mm_clmulepi64_si128(x, _mm_cvtsi64_si128(b[j]), 0);
+                res[i + j] ^= _mm_cvtsi128_si64(t);
+                res[i + j + 1] ^= _mm_cvtsi128_si64(_mm_unpackhi_epi64(t, t));
+            }
+        }
+    }
+#endif
+
+    // folds the words of mas at and above x^m down into the low n words
+    static void reduce(uint64_t* mas, size_t words) {
+        COUNT_OP(RED);
+        for (int i = (int)words - 1; 64 * i >= m;) {
+            uint64_t w = mas[i];
+            if (!w) {
+                --i;
+                continue;
+            }
+            mas[i] = 0;
+            for (int t : taps) {
+                int s = 64 * i - m + t;
+                mas[s / 64] ^= w << s % 64;
+                if (s % 64) mas[s / 64 + 1] ^= w >> (64 - s % 64);
+            }
+        }
+        if (m % 64 == 0) return;
+        for (uint64_t w; (w = mas[m / 64] >> m % 64);) {
+            mas[m / 64] ^= w << m % 64;
+            for (int t : taps) {
+                mas[t / 64] ^= w << t % 64;
+                if (t % 64 && t / 64 < m / 64) mas[t / 64 + 1] ^= w >> (64 - t % 64);
+            }
+        }
+    }
+
+    static Gf2 reduced(uint64_t* mas) {
+        reduce(mas, 2 * n);
+        Gf2 res;
+        copy(mas, mas + n, res.val);
+        return res;
+    }
+};
+
+int Gf2::m, Gf2::n;
+vector<int> Gf2::taps;
+void (*Gf2::mul_words)(const uint64_t*, const uint64_t*, uint64_t*);
+uint16_t Gf2::spread[256];
+
+ostream& operator<<(ostream& os, const Gf2& poly)
+{
+    for (size_t i = 0; i < poly.size(); ++i) {
+        os << poly[i] << ' ';
+    }
+    return os;
+}
+
 int char_to_number(char symbol) {
     if (symbol >= 48 && symbol <= 57)
         return symbol - 48;
@@ -203,26 +711,44 @@ char number_to_char(int num) {
 }
 
 Number from_any_to_10(vector<ll>& num, ll any) {
+    Stage_timer timer(RADIX);
+    auto [chunk, k] = limb_power(any);
     Number res(0);
-    Number st(1);
-    for (auto b : num) {
-        res = res + st * b;
-        st = st * Number(any);
+    ll acc = 0, mult = 1;
+    for (auto it = num.rbegin(); it != num.rend(); ++it) {
+        acc = acc * any + *it;
+        mult *= any;
+        if (mult == chunk) {
+            res *= mult;
+            res += acc;
+            acc = 0, mult = 1;
+        }
+    }
+    if (mult > 1) {
+        res *= mult;
+        res += acc;
     }
     return res;
 }
 
 vector<ll> from_10_to_any(Number num, ll any) {
+    Stage_timer timer(RADIX);
     vector<ll> res;
-    if (num == 0) return { 0 };
-    while (num > 0) {
-        res.push_back(num % any);
-        num /= any;
+    if (num.isZero()) return { 0 };
+    auto [chunk, k] = limb_power(any);
+    while (!num.isZero()) {
+        ll rem = num.divmod_small(chunk);
+        for (int i = 0; i < k; ++i) {
+            res.push_back(rem % any);
+            rem /= any;
+        }
     }
+    while (res.size() > 1 && res.back() == 0) res.pop_back();
     return res;
 }
 
 ll mpow(ll a, ll st) {
+    Stage_timer timer(MPOW);
     if (st == 0) return 1;
     ll res = mpow(a, st / 2);
     res = (res * res);
@@ -230,15 +756,45 @@ ll mpow(ll a, ll st) {
     return res;
 }
 
-Polinom mpow(Polinom a, ll st) {
-    if (st == 0) return 1;
-    Polinom res = mpow(a, st / 2);
-    res = res * res;
-    if (st % 2) res = res * a;
-    return res;
+// sliding window over the bits of st with a table of odd powers of a
+template<typename T>
+T mpow(const T& a, ll st) {
+    Stage_timer timer(MPOW);
+    OP_SCOPE("mpow");
+    Arena_scope scope;
+    if (st == 0) return scope.keep(T(1));
+    int bits = 64 - __builtin_clzll(st);
+    int w = bits <= 4 ? 1 : bits <= 12 ? 2 : bits <= 32 ? 3 : 4;
+    vector<T, Arena_allocator<T>> odd(1 << (w - 1));
+    odd[0] = a;
+    if (w > 1) {
+        T a2 = a * a;
+        for (int i = 1; i < odd.size(); ++i) odd[i] = odd[i - 1] * a2;
+    }
+    // the window of bits i..j, trimmed so that bit j is set
+    auto window = [&](int i, int& j) -> const T& {
+        j = max(i - w + 1, 0);
+        while (!(st >> j & 1)) ++j;
+        return odd[(st >> j & ((1LL << (i - j + 1)) - 1)) >> 1];
+    };
+    int j;
+    T res = window(bits - 1, j); // the top bit is set, so the first window starts res
+    for (int i = j - 1; i >= 0;) {
+        if (!(st >> i & 1)) {
+            res = res * res;
+            --i;
+            continue;
+        }
+        const T& d = window(i, j);
+        for (int t = j; t <= i; ++t) res = res * res;
+        res = res * d;
+        i = j - 1;
+    }
+    return scope.keep(res);
 }
 
 vector<ll> convert_to_mes(std::string& str) {
+    OP_SCOPE("convert_to_mes");
     vector<ll> num64;
     num64.reserve(str.size());
     for (char c : str) {
@@ -249,9 +805,73 @@ vector<ll> convert_to_mes(std::string& str) {
 
 template<typename T>
 T rev(T num) {
+    Stage_timer timer(REV);
+    OP_SCOPE("rev");
+    COUNT_OP(INV);
     return mpow(num, mpow(p, h.size() - 1) - 2);
 }
 
+ll pow_p(ll a, ll st) {
+    ll res = 1;
+    for (a %= p; st; st >>= 1, a = a * a % p) {
+        if (st & 1) res = res * a % p;
+    }
+    return res;
+}
+
+// Frobenius map a -> a^p for h = x^n - c: x^(ip) = c^(ip / n) x^(ip % n),
+// so every coefficient moves to frob[i].first and is scaled by frob[i].second
+vector<pair<int, ll>> frob;
+
+void init_frobenius() {
+    int n = h.size() - 1;
+    ll c = h_terms[0].second;
+    for (int i = 0; i < n; ++i) {
+        unsigned __int128 e = (unsigned __int128)i * p;
+        frob.push_back({ (int)(e % n), pow_p(c, (ll)(e / n % (p - 1))) });
+    }
+}
+
+Polinom frobenius(Polinom a, int times = 1) {
+    for (; times > 0; --times) {
+        Coeffs val(h.size() - 1);
+        for (int i = 0; i < a.size(); ++i) {
+            auto [j, c] = frob[i];
+            val[j] = (val[j] + a[i] * c) % p;
+        }
+        while (val.size() > 1 && val.back() == 0) val.pop_back();
+        a = Polinom(move(val));
+    }
+    return a;
+}
+
+// Itoh-Tsujii for a binomial h: a^-1 = a^(r - 1) / a^r with r = (q - 1) / (p - 1).
+// a^r lies in F_p, and a^(r - 1) = a^(p + ... + p^(n - 1)) takes about 2 log2(n)
+// multiplications once the Frobenius map is a table lookup.
+Polinom rev(Polinom num) {
+    if (!h_binomial || h.size() < 3) return rev<Polinom>(num);
+    Stage_timer timer(REV);
+    OP_SCOPE("rev");
+    COUNT_OP(INV);
+    int n = h.size() - 1;
+    // u = a^(1 + p + ... + p^(k - 1)) while k runs up the bits of n - 1
+    Polinom u = num;
+    int k = 1;
+    for (int i = 30 - __builtin_clz(n - 1); i >= 0; --i) {
+        u = u * frobenius(u, k), k *= 2;
+        if ((n - 1) >> i & 1) u = frobenius(u) * num, ++k;
+    }
+    Polinom t = frobenius(u);
+    return t * Polinom(pow_p((t * num)[0], p - 2));
+}
+
+// q - 2 does not fit into an exponent for large m
+Gf2 rev(Gf2 num) {
+    Stage_timer timer(REV);
+    OP_SCOPE("rev");
+    return num.inv();
+}
+
 void Ell_Gamal_coding(vector<Polinom> mes, Polinom g, Polinom k) {
     for (auto num : mes) {
         ll st = rand() % (p - 1) + 1;
@@ -259,45 +879,120 @@ void Ell_Gamal_coding(vector<Polinom> mes, Polinom g, Polinom k) {
     }
 }
 
-vector<Polinom> Ell_Gamal_encoding(ll a) {
-    vector<Polinom> mes;
-    while (cin.peek() != '\n' && cin.peek() != EOF) {
-        vector<ll> r_p, m_p;
-        while (cin.peek() != '\n' && cin.peek() != EOF) {
-            long long b; cin >> b;
-            b = (p + b) % p;
-            r_p.push_back(b);
-        }
-        cin.get();
-        Polinom r(r_p);
-        while (cin.peek() != '\n' && cin.peek() != EOF) {
-            long long b; cin >> b;
-            b = (p + b) % p;
-            m_p.push_back(b);
-        }
-        cin.get();
-        Polinom m(m_p);
-        auto k = mpow(r, a);
-        mes.push_back(m * rev(k));
-        if (!(k * rev(k) == Polinom(1))) {
-            cout << "Yes";
-        }
+template<typename T>
+T read_poly() {
+    string line;
+    getline(cin, line);
+    istringstream in(line);
+    vector<ll> val;
+    long long b;
+    while (in >> b) {
+        b = (p + b) % p;
+        val.push_back(b);
+    }
+    return T(val);
+}
+
+// Montgomery's trick: one rev for the product of all ks, then every inverse
+// is peeled off with two multiplications, 3(N - 1) in total
+template<typename T>
+void rev_all(vector<T>& ks) {
+    if (ks.empty()) return;
+    Arena_scope scope;
+    vector<T, Arena_allocator<T>> prefix(ks.size());
+    prefix[0] = ks[0];
+    for (size_t i = 1; i < ks.size(); ++i) prefix[i] = prefix[i - 1] * ks[i];
+    T inv = rev(prefix.back());
+    for (size_t i = ks.size() - 1; i > 0; --i) {
+        T k_inv = inv * prefix[i - 1];
+        inv = inv * ks[i];
+        ks[i] = scope.keep(k_inv);
+    }
+    ks[0] = scope.keep(inv);
+}
+
+template<typename T>
+vector<T> Ell_Gamal_encoding(ll a, size_t blocks = -1) {
+    vector<T> ks, mes;
+    for (size_t i = 0; i < blocks && cin.peek() != '\n' && cin.peek() != EOF; ++i) {
+        Arena_scope scope;
+        Stage_timer parse(PARSE);
+        T r = read_poly<T>();
+        T m = read_poly<T>();
+        parse.stop();
+        Message_timer message;
+        OP_SCOPE("block");
+        ks.push_back(scope.keep(mpow(r, a)));
+        mes.push_back(scope.keep(m));
     }
+    rev_all(ks);
+    for (size_t i = 0; i < mes.size(); ++i) mes[i] = mes[i] * ks[i];
     return mes;
 }
 
-void convert_to_str(vector<ll>& mes) {
+void convert_to_str(vector<ll>& mes, size_t chars = 0) {
+    OP_SCOPE("convert_to_str");
     auto res = from_10_to_any(from_any_to_10(mes, p), 64);
+    // characters with value 0 at the end of a message are not in the number
+    if (res.size() < chars) res.resize(chars, 0);
+    Stage_timer output(OUTPUT);
     for (auto el : res) {
         cout << number_to_char(el);
     }
 }
 
-int main() {
+template<typename T>
+vector<ll> to_digits(const vector<T>& polies) {
+    vector<ll> mes;
+    for (auto& poly : polies) {
+        for (int i = 0; i + 1 < h.size(); ++i) {
+            mes.push_back(poly[i]);
+        }
+    }
+    return mes;
+}
+
+// --batch: frames "<chars> <blocks>" written by the encryptor's --batch,
+// every frame is a separate message printed on its own line
+template<typename T>
+void batch_decoding(ll a) {
+    size_t chars, blocks;
+    while (true) {
+        Stage_timer parse(PARSE);
+        if (!(cin >> chars >> blocks)) break;
+        cin.get();
+        parse.stop();
+        if (blocks) {
+            auto mes = to_digits(Ell_Gamal_encoding<T>(a, blocks));
+            convert_to_str(mes, chars);
+        }
+        cout << '\n';
+    }
+}
+
+template<typename T>
+void run(ll a, bool batch) {
+    if (batch) {
+        batch_decoding<T>(a);
+        return;
+    }
+    auto mes = to_digits(Ell_Gamal_encoding<T>(a));
+    convert_to_str(mes);
+}
+
+int main(int argc, char* argv[]) {
     srand(time(NULL));
+    bool batch = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--batch") batch = true;
+        if (arg == "--stats") stats.enabled = true;
+        if (arg == "--stats-json" && i + 1 < argc) stats.enabled = true, stats.json_path = argv[++i];
+    }
     ios_base::sync_with_stdio(false);
     cin.tie(NULL);
     cout.tie(NULL);
+    Stage_timer parse(PARSE);
     cin >> p;
     cin.get();
     while (cin.peek() != '\n') {
@@ -314,18 +1009,25 @@ int main() {
         h[i] = (p - h[i]) % p;
     }
     h.back() *= -1;
+    for (int i = 0; i + 1 < h.size(); ++i) {
+        if (h[i]) h_terms.push_back({ i, h[i] });
+    }
+    h_binomial = h_terms.size() == 1 && h_terms[0].first == 0;
+    if (h_binomial) init_frobenius();
     cin.get();
     ll a; cin >> a;
     cin.get();
-    auto polies = Ell_Gamal_encoding(a);
-    vector<ll> mes;
-    for (auto& poly : polies) {
-        for (auto el : poly) {
-            mes.push_back(el);
-        }
-        for (int i = poly.size(); i + 1 < h.size(); ++i) {
-            mes.push_back(0);
-        }
+    parse.stop();
+    if (p != 2) {
+        run<Polinom>(a, batch);
+        return 0;
     }
-    convert_to_str(mes);
+    // F_2 has no useful generator, and Polinom's ll exponents overflow for
+    // larger fields, so p = 2 only runs on Gf2
+    if (h.size() < 3 || h.size() - 1 > 64 * Gf2::max_words) {
+        cerr << "for p = 2, deg h must be between 2 and " << 64 * Gf2::max_words << '\n';
+        return 1;
+    }
+    Gf2::init();
+    run<Gf2>(a, batch);
 }
\ No newline at end of file
@@ -3,6 +3,25 @@
 #include <vector>
 #include <string>
 #include <iomanip>
+#include <sstream>
+#include <cstdint>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <type_traits>
+#include <new>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <cstring>
+#ifdef FIELD_GMP
+#include <gmpxx.h>
+#endif
 
 using namespace std;
 typedef long long ll;
@@ -14,9 +33,373 @@ constexpr int digits(int base) noexcept {
 constexpr int base = 1000'000'000;
 constexpr int base_digits = digits(base);
 
+// Decimal codec helpers. A limb holds 9 digits; its low 8 digits are parsed
+// as one 64-bit word (SWAR) and printed two digits at a time from a table.
+inline uint32_t parse8(const char* s) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, s, 8);
+    v -= 0x3030303030303030ULL;
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))
+        + ((v >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32))) >> 32;
+    return (uint32_t)v;
+#else
+    uint32_t v = 0;
+    for (int i = 0; i < 8; ++i) v = v * 10 + (s[i] - '0');
+    return v;
+#endif
+}
+
+constexpr char digit_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+// the limb as exactly base_digits digits
+inline void format9(char* out, uint32_t v) {
+    out[0] = char('0' + v / 100000000);
+    v %= 100000000;
+    for (int i = 7; i > 0; i -= 2, v /= 100)
+        memcpy(out + i, digit_pairs + 2 * (v % 100), 2);
+}
+
+// --stats: cumulative time per stage and per-message latency percentiles,
+// printed to stderr at exit; --stats-json <file> writes them as JSON instead.
+// Stages nest (e.g. mpow inside rev), so their times overlap.
+enum Stage { PARSE, RADIX, MPOW, REV, OUTPUT, STAGES };
+const char* stage_names[STAGES] = { "parse", "radix", "mpow", "rev", "output" };
+
+struct Stats {
+    static constexpr int buckets = 256; // 4 buckets per power of two nanoseconds
+    bool enabled = false;
+    string json_path;
+    atomic<long long> stage_ns[STAGES] = {};
+    atomic<long long> latency[buckets] = {};
+    atomic<long long> messages{ 0 }, max_latency{ 0 };
+
+    static long long now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void add_latency(long long ns) {
+        int bucket = ns > 1 ? min(buckets - 1, (int)(4 * log2((double)ns))) : 0;
+        ++latency[bucket];
+        ++messages;
+        long long cur = max_latency;
+        while (ns > cur && !max_latency.compare_exchange_weak(cur, ns));
+    }
+
+    // upper bound of the bucket holding the q-th quantile, in microseconds
+    double percentile(double q) const {
+        long long need = max(1LL, (long long)ceil(q * messages)), seen = 0;
+        for (int i = 0; i < buckets; ++i) {
+            seen += latency[i];
+            if (seen >= need) return min(exp2((i + 1) / 4.0), (double)max_latency) / 1e3;
+        }
+        return max_latency / 1e3;
+    }
+
+    void report() const {
+        const double qs[] = { 0.5, 0.9, 0.99 };
+        const char* names[] = { "p50", "p90", "p99" };
+        if (json_path.empty()) {
+            cerr << "stage     total_ms\n";
+            for (int i = 0; i < STAGES; ++i)
+                cerr << left << setw(10) << stage_names[i] << stage_ns[i] / 1e6 << '\n';
+            cerr << "latency_us messages=" << messages;
+            for (int i = 0; i < 3; ++i)
+                cerr << ' ' << names[i] << '=' << (messages ? percentile(qs[i]) : 0);
+            cerr << " max=" << max_latency / 1e3 << '\n';
+            return;
+        }
+        ofstream os(json_path);
+        os << "{\"stages_ms\": {";
+        for (int i = 0; i < STAGES; ++i)
+            os << (i ? ", " : "") << '"' << stage_names[i] << "\": " << stage_ns[i] / 1e6;
+        os << "}, \"latency_us\": {\"messages\": " << messages;
+        for (int i = 0; i < 3; ++i)
+            os << ", \"" << names[i] << "\": " << (messages ? percentile(qs[i]) : 0);
+        os << ", \"max\": " << max_latency / 1e3 << "}}\n";
+    }
+
+    ~Stats() {
+        if (enabled) report();
+    }
+} stats;
+
+// Instrumentation build (-DCOUNT_OPS): counts arithmetic operations and heap
+// allocations per high-level operation and prints them to stderr at exit.
+#ifdef COUNT_OPS
+enum Op_kind { MUL, SQR, RED, DIV, INV, ALLOC, OP_KINDS };
+const char* op_kind_names[OP_KINDS] = { "mul", "sqr", "reduce", "div", "inv", "alloc" };
+thread_local long long op_count[OP_KINDS];
+thread_local const char* op_stack[32];
+thread_local int op_depth;
+
+struct Op_report {
+    struct Totals {
+        long long calls = 0;
+        long long count[OP_KINDS] = {};
+    };
+    mutex mtx;
+    map<string, Totals> ops;
+
+    ~Op_report() {
+        cerr << left << setw(20) << "op" << setw(10) << "calls";
+        for (auto name : op_kind_names)
+            cerr << setw(12) << name;
+        cerr << "(per call)\n";
+        for (auto& [name, t] : ops) {
+            cerr << setw(20) << name << setw(10) << t.calls;
+            for (auto c : t.count)
+                cerr << setw(12) << (double)c / t.calls;
+            cerr << '\n';
+        }
+    }
+} op_report;
+
+// only the outermost scope of a name is counted, so recursion is one call
+class Op_scope {
+    const char* name = nullptr;
+    long long start[OP_KINDS];
+    public:
+    explicit Op_scope(const char* name) {
+        for (int i = 0; i < op_depth; ++i)
+            if (op_stack[i] == name) return;
+        this->name = name;
+        op_stack[op_depth++] = name;
+        copy(op_count, op_count + OP_KINDS, start);
+    }
+    ~Op_scope() {
+        if (!name) return;
+        --op_depth;
+        long long delta[OP_KINDS];
+        for (int i = 0; i < OP_KINDS; ++i)
+            delta[i] = op_count[i] - start[i];
+        lock_guard<mutex> lock(op_report.mtx);
+        auto& t = op_report.ops[name];
+        ++t.calls;
+        for (int i = 0; i < OP_KINDS; ++i)
+            t.count[i] += delta[i];
+    }
+};
+
+// the replacements pair malloc with free, gcc only sees new paired with free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t n) {
+    ++op_count[ALLOC];
+    if (void* ptr = malloc(n ? n : 1)) return ptr;
+    throw bad_alloc();
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+#pragma GCC diagnostic pop
+
+#define COUNT_OP(kind) (++op_count[kind])
+#define OP_SCOPE(name) Op_scope op_scope_(name)
+#else
+#define COUNT_OP(kind) ((void)0)
+#define OP_SCOPE(name) ((void)0)
+#endif
+
+thread_local int stage_depth[STAGES];
+
+// only the outermost timer of a stage on each thread is counted
+class Stage_timer {
+    Stage stage;
+    bool running;
+    long long start = 0;
+    public:
+    explicit Stage_timer(Stage stage) : stage(stage), running(stats.enabled) {
+        if (running && stage_depth[stage]++ == 0) start = Stats::now();
+    }
+    void stop() {
+        if (!running) return;
+        running = false;
+        if (--stage_depth[stage] == 0) stats.stage_ns[stage] += Stats::now() - start;
+    }
+    ~Stage_timer() { stop(); }
+};
+
+class Message_timer {
+    long long start = 0;
+    public:
+    Message_timer() {
+        if (stats.enabled) start = Stats::now();
+    }
+    ~Message_timer() {
+        if (stats.enabled) stats.add_latency(Stats::now() - start);
+    }
+};
+
+// Per-thread bump allocator for arithmetic temporaries. While an
+// Arena_scope is open, bigint limbs beyond the inline buffer come from the thread's arena and
+// frees are no-ops; the outermost scope releases everything in O(1).
+// Values that outlive the scope must leave it through Arena_scope::keep;
+// -DARENA_CHECK aborts when an arena pointer is freed after its scope ended.
+class Arena {
+    struct Block {
+        char* mem;
+        size_t size;
+    };
+    vector<Block> blocks;
+    size_t block = 0, used = 0;
+
+    public:
+    int depth = 0;
+    bool paused = false;
+    size_t generation = 0; // bumped by every reset
+
+    ~Arena() {
+#ifndef ARENA_CHECK // the checks still read headers of late frees
+        for (auto& b : blocks) free(b.mem);
+#endif
+    }
+
+    bool active() const { return depth > 0 && !paused; }
+
+    void* allocate(size_t n) {
+        n = (n + 15) & ~(size_t)15;
+        while (block < blocks.size() && used + n > blocks[block].size) ++block, used = 0;
+        if (block == blocks.size()) {
+            size_t size = max(n, (size_t)1 << 20);
+            blocks.push_back({ (char*)malloc(size), size });
+            used = 0;
+        }
+        void* ptr = blocks[block].mem + used;
+        used += n;
+        return ptr;
+    }
+
+    void reset() { block = 0, used = 0, ++generation; }
+};
+
+thread_local Arena arena;
+
+// Every allocation starts with a header saying where it came from, so a free
+// never asks the arena, which is destroyed before global values are.
+struct Arena_header {
+    const Arena* owner; // nullptr for the heap
+    size_t generation;
+};
+
+void* arena_allocate(size_t n) {
+    bool active = arena.active();
+    n += sizeof(Arena_header);
+    auto* header = (Arena_header*)(active ? arena.allocate(n) : ::operator new(n));
+    *header = { active ? &arena : nullptr, arena.generation };
+    return header + 1;
+}
+
+void arena_deallocate(void* ptr) {
+    if (!ptr) return;
+    auto* header = (Arena_header*)ptr - 1;
+#ifdef ARENA_CHECK
+    if (header->owner && (header->owner != &arena || header->generation != arena.generation)) {
+        cerr << "arena pointer escaped its Arena_scope\n";
+        abort();
+    }
+#endif
+    if (!header->owner) ::operator delete(header);
+}
+
+class Arena_scope {
+    public:
+    Arena_scope() { ++arena.depth; }
+    ~Arena_scope() {
+        if (--arena.depth == 0) arena.reset();
+    }
+    Arena_scope(const Arena_scope&) = delete;
+
+    // copies the result to the heap when it leaves the outermost scope
+    template<typename T>
+    T keep(const T& value) {
+        if (arena.depth > 1) return value;
+        arena.paused = true;
+        T res(value);
+        arena.paused = false;
+        return res;
+    }
+};
+
+#ifndef BIGINT_INLINE_LIMBS
+#define BIGINT_INLINE_LIMBS 20
+#endif
+
+// Limb storage for bigint: up to N limbs live inside the object, so curve
+// arithmetic does not allocate; longer numbers (message conversion) move
+// to the heap.
+template<int N>
+class Small_limbs {
+    size_t len = 0, cap = N;
+    int* heap = nullptr;
+    int buf[N];
+
+    void grow(size_t need) {
+        size_t new_cap = max(need, 2 * cap);
+        int* mem = (int*)arena_allocate(new_cap * sizeof(int));
+        memcpy(mem, data(), len * sizeof(int));
+        arena_deallocate(heap);
+        heap = mem;
+        cap = new_cap;
+    }
+
+    public:
+    Small_limbs() {}
+    Small_limbs(const Small_limbs& other) { *this = other; }
+    Small_limbs(Small_limbs&& other) noexcept { *this = move(other); }
+    ~Small_limbs() { arena_deallocate(heap); }
+
+    Small_limbs& operator=(const Small_limbs& other) {
+        if (this == &other) return *this;
+        len = 0;
+        if (other.len > cap) grow(other.len);
+        len = other.len;
+        memcpy(data(), other.data(), len * sizeof(int));
+        return *this;
+    }
+
+    Small_limbs& operator=(Small_limbs&& other) noexcept {
+        if (this == &other) return *this;
+        if (!other.heap) return *this = other;
+        arena_deallocate(heap);
+        heap = other.heap, cap = other.cap, len = other.len;
+        other.heap = nullptr, other.cap = N, other.len = 0;
+        return *this;
+    }
+
+    int* data() { return heap ? heap : buf; }
+    const int* data() const { return heap ? heap : buf; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    void clear() { len = 0; }
+    int& operator[](size_t i) { return data()[i]; }
+    int operator[](size_t i) const { return data()[i]; }
+    int& back() { return data()[len - 1]; }
+    int back() const { return data()[len - 1]; }
+    int* begin() { return data(); }
+    int* end() { return data() + len; }
+    const int* begin() const { return data(); }
+    const int* end() const { return data() + len; }
+
+    void push_back(int v) {
+        if (len == cap) grow(len + 1);
+        data()[len++] = v;
+    }
+    void pop_back() { --len; }
+    void resize(size_t n) {
+        if (n > cap) grow(n);
+        if (n > len) memset(data() + len, 0, (n - len) * sizeof(int));
+        len = n;
+    }
+
+    bool operator==(const Small_limbs& other) const {
+        return len == other.len && memcmp(data(), other.data(), len * sizeof(int)) == 0;
+    }
+};
+
 struct bigint {
     // value == 0 is represented by empty z
-    vector<int> z; // digits
+    Small_limbs<BIGINT_INLINE_LIMBS> z; // digits
 
 // sign == 1 <==> value >= 0
 // sign == -1 <==> value < 0
@@ -56,6 +439,11 @@ struct bigint {
         return a;
     }
 
+    friend bigint operator+(const bigint& a, bigint&& b) {
+        b += a;
+        return move(b);
+    }
+
     bigint& operator-=(const bigint& other) {
         if (sign == other.sign) {
             if ((sign == 1 && *this >= other) || (sign == -1 && *this <= other)) {
@@ -123,9 +511,17 @@ struct bigint {
         return { q, r / norm };
     }
 
-    bigint operator/(const bigint& v) const { return divmod(*this, v).first; }
+    bigint operator/(const bigint& v) const {
+        COUNT_OP(DIV);
+        return divmod(*this, v).first;
+    }
 
-    bigint operator%(const bigint& v) const { return divmod(*this, v).second; }
+    bigint operator%(const bigint& v) const {
+        bigint r = *this;
+        rem_abs(r, v);
+        if (sign == -1 && !r.isZero()) r.sign = -1;
+        return r;
+    }
 
     bigint& operator/=(int v) {
         if (v < 0)
@@ -151,7 +547,10 @@ struct bigint {
     }
 
     bigint& operator*=(const bigint& v) {
-        *this = *this * v;
+        bigint res;
+        if (&v == this) sqr_into(res, v);
+        else mul_into(res, *this, v);
+        *this = move(res);
         return *this;
     }
 
@@ -161,7 +560,9 @@ struct bigint {
     }
 
     bigint& operator%=(const bigint& v) {
-        *this = *this % v;
+        bool neg = sign == -1;
+        rem_abs(*this, v);
+        if (neg && !isZero()) sign = -1;
         return *this;
     }
 
@@ -214,38 +615,62 @@ struct bigint {
 
     friend bigint lcm(const bigint& a, const bigint& b) { return a / gcd(a, b) * b; }
 
-    void read(const string& s) {
+    void read(const string& s) { parse(s.data(), s.data() + s.size()); }
+
+    // reads an optionally signed decimal from [s, end), returns the first unused char
+    const char* parse(const char* s, const char* end) {
         sign = 1;
         z.clear();
-        int pos = 0;
-        while (pos < s.size() && (s[pos] == '-' || s[pos] == '+')) {
-            if (s[pos] == '-')
+        for (; s < end && (*s == '-' || *s == '+'); ++s)
+            if (*s == '-')
                 sign = -sign;
-            ++pos;
-        }
-        for (int i = (int)s.size() - 1; i >= pos; i -= base_digits) {
+        const char* first = s;
+        while (s < end && (unsigned)(*s - '0') < 10) ++s;
+        z.resize((s - first + base_digits - 1) / base_digits);
+        const char* i = s;
+        for (size_t k = 0; i - first >= base_digits; ++k, i -= base_digits)
+            z[k] = (i[-9] - '0') * 100000000 + parse8(i - 8);
+        if (i > first) {
             int x = 0;
-            for (int j = max(pos, i - base_digits + 1); j <= i; j++)
-                x = x * 10 + s[j] - '0';
-            z.push_back(x);
+            for (const char* j = first; j < i; ++j)
+                x = x * 10 + *j - '0';
+            z.back() = x;
         }
         trim();
+        return s;
+    }
+
+    // writes the number to out, which needs room for size_bound() chars; returns the end
+    char* format(char* out) const {
+        if (sign == -1)
+            *out++ = '-';
+        if (z.empty()) {
+            *out++ = '0';
+            return out;
+        }
+        char head[base_digits];
+        int len = 0;
+        for (uint32_t v = z.back(); v; v /= 10) head[len++] = char('0' + v % 10);
+        while (len) *out++ = head[--len];
+        for (int i = (int)z.size() - 2; i >= 0; --i, out += base_digits)
+            format9(out, z[i]);
+        return out;
     }
+    size_t size_bound() const { return 1 + base_digits * max((size_t)1, z.size()); }
 
     friend istream& operator>>(istream& stream, bigint& v) {
-        string s;
+        thread_local string s;
         stream >> s;
-        v.read(s);
+        v.parse(s.data(), s.data() + s.size());
         return stream;
     }
 
     friend ostream& operator<<(ostream& stream, const bigint& v) {
-        if (v.sign == -1)
-            stream << '-';
-        stream << (v.z.empty() ? 0 : v.z.back());
-        for (int i = (int)v.z.size() - 2; i >= 0; --i)
-            stream << setw(base_digits) << setfill('0') << v.z[i];
-        return stream;
+        char buf[1 + base_digits * 16];
+        if (v.size_bound() <= sizeof(buf))
+            return stream.write(buf, v.format(buf) - buf);
+        string s(v.size_bound(), '\0');
+        return stream.write(s.data(), v.format(s.data()) - s.data());
     }
 
     static vector<int> convert_base(const vector<int>& a, int old_digits, int new_digits) {
@@ -277,103 +702,1157 @@ struct bigint {
 
     bigint mul_simple(const bigint& v) const {
         bigint res;
-        res.sign = sign * v.sign;
-        res.z.resize(z.size() + v.z.size());
-        for (int i = 0; i < z.size(); ++i)
-            if (z[i])
-                for (int j = 0, carry = 0; j < v.z.size() || carry; ++j) {
-                    long long cur = res.z[i + j] + (long long)z[i] * (j < v.z.size() ? v.z[j] : 0) + carry;
+        if (&v == this) sqr_into(res, v);
+        else mul_into(res, *this, v);
+        return res;
+    }
+
+    // res = a * b, res must not alias a or b
+    friend void mul_into(bigint& res, const bigint& a, const bigint& b) {
+        COUNT_OP(MUL);
+        res.sign = a.sign * b.sign;
+        res.z.clear();
+        res.z.resize(a.z.size() + b.z.size());
+        for (int i = 0; i < a.z.size(); ++i)
+            if (a.z[i])
+                for (int j = 0, carry = 0; j < b.z.size() || carry; ++j) {
+                    long long cur = res.z[i + j] + (long long)a.z[i] * (j < b.z.size() ? b.z[j] : 0) + carry;
+                    carry = (int)(cur / base);
+                    res.z[i + j] = (int)(cur % base);
+                }
+        res.trim();
+    }
+
+    // res = a * a, cross products are computed once and doubled
+    friend void sqr_into(bigint& res, const bigint& a) {
+        COUNT_OP(SQR);
+        int n = a.z.size();
+        res.sign = 1;
+        res.z.clear();
+        res.z.resize(2 * n);
+        for (int i = 0; i < n; ++i)
+            if (a.z[i])
+                for (int j = i + 1, carry = 0; j < n || carry; ++j) {
+                    long long cur = res.z[i + j] + (long long)a.z[i] * (j < n ? a.z[j] : 0) + carry;
                     carry = (int)(cur / base);
                     res.z[i + j] = (int)(cur % base);
                 }
+        for (int i = 0, carry = 0; i < 2 * n; ++i) {
+            long long cur = 2LL * res.z[i] + carry;
+            carry = (int)(cur / base);
+            res.z[i] = (int)(cur % base);
+        }
+        for (int i = 0, carry = 0; i < n || carry; ++i) {
+            long long sq = i < n ? (long long)a.z[i] * a.z[i] : 0;
+            long long lo = res.z[2 * i] + sq % base + carry;
+            long long hi = res.z[2 * i + 1] + sq / base + lo / base;
+            res.z[2 * i] = (int)(lo % base);
+            res.z[2 * i + 1] = (int)(hi % base);
+            carry = (int)(hi / base);
+        }
         res.trim();
+    }
+
+    // r = |r| mod |m| in place, Knuth's division keeping only the remainder
+    friend void rem_abs(bigint& r, const bigint& m) {
+        COUNT_OP(RED);
+        r.sign = 1;
+        int n = m.z.size();
+        if (r.z.size() < n) return;
+        int norm = base / (m.z.back() + 1);
+        bigint b = m;
+        b.sign = 1;
+        b *= norm;
+        r *= norm;
+        r.z.push_back(0);
+        for (int i = (int)r.z.size() - n - 1; i >= 0; --i) {
+            long long d = ((long long)r.z[i + n] * base + r.z[i + n - 1]) / b.z[n - 1];
+            if (d >= base) d = base - 1;
+            long long carry = 0, borrow = 0;
+            for (int j = 0; j < n; ++j) {
+                long long cur = b.z[j] * d + carry;
+                carry = cur / base;
+                long long sub = r.z[i + j] - cur % base - borrow;
+                borrow = sub < 0;
+                r.z[i + j] = (int)(sub + borrow * base);
+            }
+            long long top = r.z[i + n] - carry - borrow;
+            while (top < 0) {
+                int c = 0;
+                for (int j = 0; j < n; ++j) {
+                    int sum = r.z[i + j] + b.z[j] + c;
+                    c = sum >= base;
+                    r.z[i + j] = sum - c * base;
+                }
+                top += c;
+            }
+            r.z[i + n] = (int)top;
+        }
+        r.trim();
+        r /= norm;
+    }
+
+    // r = r mod m in [0, m)
+    friend void reduce(bigint& r, const bigint& m) {
+        bool neg = r.sign == -1;
+        rem_abs(r, m);
+        if (neg && !r.isZero()) {
+            r.sign = -1;
+            r += m;
+        }
+    }
+
+    // res = a * b mod m in [0, m), res may alias a or b
+    friend void mulmod(bigint& res, const bigint& a, const bigint& b, const bigint& m) {
+        if (&res != &a && &res != &b) {
+            mul_into(res, a, b);
+            reduce(res, m);
+            return;
+        }
+        bigint prod;
+        mul_into(prod, a, b);
+        reduce(prod, m);
+        res = move(prod);
+    }
+
+    // res = a * a mod m in [0, m), res may alias a
+    friend void sqrmod(bigint& res, const bigint& a, const bigint& m) {
+        if (&res != &a) {
+            sqr_into(res, a);
+            reduce(res, m);
+            return;
+        }
+        bigint prod;
+        sqr_into(prod, a);
+        reduce(prod, m);
+        res = move(prod);
+    }
+};
+
+// v in [0, 2^(64 * n)) to n little-endian 64-bit words and back, by Horner's
+// rule over the base 10^9 limbs; no bigint divisions
+void to_words(const bigint& v, uint64_t* w, int n) {
+    memset(w, 0, n * sizeof(uint64_t));
+    for (int i = (int)v.z.size() - 1; i >= 0; --i) {
+        unsigned __int128 c = (unsigned)v.z[i];
+        for (int j = 0; j < n; ++j) {
+            c += (unsigned __int128)w[j] * base;
+            w[j] = (uint64_t)c;
+            c >>= 64;
+        }
+    }
+}
+
+bigint from_words(const uint64_t* w, int n) {
+    uint64_t t[16];
+    memcpy(t, w, n * sizeof(uint64_t));
+    while (n > 0 && t[n - 1] == 0) --n;
+    bigint res;
+    while (n > 0) {
+        unsigned __int128 rem = 0;
+        for (int j = n - 1; j >= 0; --j) {
+            rem = rem << 64 | t[j];
+            t[j] = (uint64_t)(rem / base);
+            rem %= base;
+        }
+        res.z.push_back((int)rem);
+        while (n > 0 && t[n - 1] == 0) --n;
+    }
+    return res;
+}
+
+bigint p, a, b, deg;
+
+bigint rev(const bigint& num) {
+    Stage_timer timer(REV);
+    OP_SCOPE("rev");
+    COUNT_OP(INV);
+    // extended Euclid, s_i * num == r_i (mod p)
+    bigint r0 = p, r1 = num, s0 = 0, s1 = 1, q, t;
+    reduce(r1, p);
+    while (!r1.isZero()) {
+        q = r0 / r1;
+        mul_into(t, q, r1);
+        r0 -= t;
+        swap(r0, r1);
+        mul_into(t, q, s1);
+        s0 -= t;
+        swap(s0, s1);
+    }
+    reduce(s0, p);
+    return s0;
+}
+
+// binary digits of a non-negative scalar, least significant first
+template<typename T>
+vector<char> scalar_bits(T st) {
+    vector<char> bits;
+    for (; st != 0; st /= 2) bits.push_back(st % 2 != 0);
+    return bits;
+}
+
+// Field arithmetic backends for the curve code. A backend has an element
+// type fe and static init/from/to/zero/one/add/sub/mul/sqr/inv/is_zero/equal;
+// elements are always kept reduced mod p. init() runs once p is known.
+// Pick one with -DFIELD_BIGINT or -DFIELD_GMP (link with -lgmpxx -lgmp),
+// the default is Fixed_field, Mersenne_field for P-521 and Curve25519_field
+// for Ed25519.
+
+// the decimal bigint above
+struct Bigint_field {
+    typedef bigint fe;
+    static void init() {}
+    static fe from(const bigint& v) {
+        fe r = v;
+        reduce(r, p);
+        return r;
+    }
+    static bigint to(const fe& v) { return v; }
+    static fe zero() { return 0; }
+    static fe one() { return 1; }
+    static void add(fe& r, const fe& x, const fe& y) {
+        r = x + y;
+        if (r >= p) r -= p;
+    }
+    static void sub(fe& r, const fe& x, const fe& y) {
+        r = x - y;
+        if (r < 0) r += p;
+    }
+    static void mul(fe& r, const fe& x, const fe& y) { mulmod(r, x, y, p); }
+    static void sqr(fe& r, const fe& x) { sqrmod(r, x, p); }
+    static fe inv(const fe& x) { return rev(x); }
+    static bool is_zero(const fe& x) { return x.isZero(); }
+    static bool equal(const fe& x, const fe& y) { return x == y; }
+};
+
+// Curve tags: field size in 64-bit limbs, parameters in decimal, n is the order of g.
+// Messages without --chunked get plain_pad_bits low bits to search for a point.
+struct P256 {
+    static constexpr int limbs = 4;
+    static constexpr int plain_pad_bits = 0;
+    static constexpr int cofactor = 1;
+    static constexpr const char* name = "P-256";
+    static constexpr const char* p = "115792089210356248762697446949407573530086143415290314195533631308867097853951";
+    static constexpr const char* a = "-3";
+    static constexpr const char* b = "41058363725152142129326129780047268409114441015993725554835256314039467401291";
+    static constexpr const char* gx = "48439561293906451759052585252797914202762949526041747995844080717082404635286";
+    static constexpr const char* gy = "36134250956749795798585127919587881956611106672985015071877198253568414405109";
+    static constexpr const char* n = "115792089210356248762697446949407573529996955224135760342422259061068512044369";
+};
+
+struct P384 {
+    static constexpr int limbs = 6;
+    static constexpr int plain_pad_bits = 0;
+    static constexpr int cofactor = 1;
+    static constexpr const char* name = "P-384";
+    static constexpr const char* p = "39402006196394479212279040100143613805079739270465446667948293404245721771496870329047266088258938001861606973112319";
+    static constexpr const char* a = "-3";
+    static constexpr const char* b = "27580193559959705877849011840389048093056905856361568521428707301988689241309860865136260764883745107765439761230575";
+    static constexpr const char* gx = "26247035095799689268623156744566981891852923491109213387815615900925518854738050089022388053975719786650872476732087";
+    static constexpr const char* gy = "8325710961489029985546751289520108179287853048861315594709205902480503199884419224438643760392947333078086511627871";
+    static constexpr const char* n = "39402006196394479212279040100143613805079739270465446667946905279627659399113263569398956308152294913554433653942643";
+};
+
+struct P521 {
+    static constexpr int limbs = 9;
+    static constexpr int plain_pad_bits = 0;
+    static constexpr int cofactor = 1;
+    static constexpr const char* name = "P-521";
+    static constexpr const char* p = "6864797660130609714981900799081393217269435300143305409394463459185543183397656052122559640661454554977296311391480858037121987999716643812574028291115057151";
+    static constexpr const char* a = "-3";
+    static constexpr const char* b = "1093849038073734274511112390766805569936207598951683748994586394495953116150735016013708737573759623248592132296706313309438452531591012912142327488478985984";
+    static constexpr const char* gx = "2661740802050217063228768716723360960729859168756973147706671368418802944996427808491545080627771902352094241225065558662157113545570916814161637315895999846";
+    static constexpr const char* gy = "3757180025770020463545507224491183603594455134769762486694567779615544477440556316691234405012945539562144444537289428522585666729196580810124344277578376784";
+    static constexpr const char* n = "6864797660130609714981900799081393217269435300143305409394463459185543183397655394245057746333217197532963996371363321113864768612440380340372808892707005449";
+};
+
+// twisted Edwards -x^2 + y^2 = 1 + d * x^2 * y^2, birationally equivalent to Curve25519
+struct Ed25519 {
+    static constexpr int limbs = 4;
+    static constexpr int plain_pad_bits = 8;
+    static constexpr int cofactor = 8;
+    static constexpr const char* name = "Ed25519";
+    static constexpr const char* p = "57896044618658097711785492504343953926634992332820282019728792003956564819949";
+    static constexpr const char* a = "-1";
+    static constexpr const char* d = "37095705934669439343138083508754565189542113879843219016388785533085940283555";
+    static constexpr const char* gx = "15112221349535400772501151409588531511454012693041857206046113283949847762202";
+    static constexpr const char* gy = "46316835694926478169428394003475163141307993866256225615783033603165251855960";
+    static constexpr const char* n = "7237005577332262213973186563042994240857116359379907606001950938285454250989";
+};
+
+// Curve::limbs 64-bit limbs in Montgomery form (R = 2^(64 * limbs))
+template<typename Curve>
+struct Fixed_field {
+    static constexpr int n = Curve::limbs;
+    struct fe {
+        uint64_t v[n];
+    };
+    static inline uint64_t m[n], m_inv; // p and -p^-1 mod 2^64
+    static inline fe r2, r1; // R^2 and R mod p
+
+    static void init() {
+        fe raw = to_limbs(p);
+        memcpy(m, raw.v, sizeof(m));
+        uint64_t inv = m[0];
+        for (int i = 0; i < 6; ++i) inv *= 2 - m[0] * inv;
+        m_inv = 0 - inv;
+        bigint r = 1;
+        for (int i = 0; i < 128 * n; ++i) {
+            r *= 2;
+            if (r >= p) r -= p;
+            if (i + 1 == 64 * n) r1 = to_limbs(r);
+        }
+        r2 = to_limbs(r);
+    }
+
+    static fe to_limbs(const bigint& v) {
+        fe r;
+        to_words(v, r.v, n);
+        return r;
+    }
+
+    static fe from(const bigint& v) {
+        bigint x = v;
+        reduce(x, p);
+        fe r = to_limbs(x);
+        mul(r, r, r2);
+        return r;
+    }
+
+    static bigint to(const fe& x) {
+        fe raw{}, r;
+        raw.v[0] = 1;
+        mul(r, x, raw);
+        return from_words(r.v, n);
+    }
+
+    static fe zero() { return fe{}; }
+    static fe one() { return r1; }
+
+    // r = t - p if t (n limbs plus carry bit) >= p, else t
+    static void sub_p(fe& r, const uint64_t* t, uint64_t carry) {
+        uint64_t d[n], borrow = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 s = (unsigned __int128)t[i] - m[i] - borrow;
+            d[i] = (uint64_t)s;
+            borrow = (uint64_t)(s >> 64) & 1;
+        }
+        if (carry || !borrow) memcpy(r.v, d, sizeof(d));
+        else memcpy(r.v, t, sizeof(d));
+    }
+
+    static void add(fe& r, const fe& x, const fe& y) {
+        uint64_t t[n], carry = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 s = (unsigned __int128)x.v[i] + y.v[i] + carry;
+            t[i] = (uint64_t)s;
+            carry = (uint64_t)(s >> 64);
+        }
+        sub_p(r, t, carry);
+    }
+
+    static void sub(fe& r, const fe& x, const fe& y) {
+        uint64_t t[n], borrow = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 s = (unsigned __int128)x.v[i] - y.v[i] - borrow;
+            t[i] = (uint64_t)s;
+            borrow = (uint64_t)(s >> 64) & 1;
+        }
+        if (borrow) {
+            uint64_t carry = 0;
+            for (int i = 0; i < n; ++i) {
+                unsigned __int128 s = (unsigned __int128)t[i] + m[i] + carry;
+                t[i] = (uint64_t)s;
+                carry = (uint64_t)(s >> 64);
+            }
+        }
+        memcpy(r.v, t, sizeof(t));
+    }
+
+    static void mul(fe& r, const fe& x, const fe& y) {
+        COUNT_OP(MUL);
+        mul_(r, x, y);
+    }
+
+    static void sqr(fe& r, const fe& x) {
+        COUNT_OP(SQR);
+        mul_(r, x, x);
+    }
+
+    // CIOS Montgomery multiplication, r = x * y / R mod p
+    static void mul_(fe& r, const fe& x, const fe& y) {
+        uint64_t t[n + 2] = {};
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 c = 0;
+            for (int j = 0; j < n; ++j) {
+                c += (unsigned __int128)x.v[j] * y.v[i] + t[j];
+                t[j] = (uint64_t)c;
+                c >>= 64;
+            }
+            c += t[n];
+            t[n] = (uint64_t)c;
+            t[n + 1] = (uint64_t)(c >> 64);
+            uint64_t q = t[0] * m_inv;
+            c = ((unsigned __int128)q * m[0] + t[0]) >> 64;
+            for (int j = 1; j < n; ++j) {
+                c += (unsigned __int128)q * m[j] + t[j];
+                t[j - 1] = (uint64_t)c;
+                c >>= 64;
+            }
+            c += t[n];
+            t[n - 1] = (uint64_t)c;
+            t[n] = t[n + 1] + (uint64_t)(c >> 64);
+        }
+        sub_p(r, t, t[n]);
+    }
+
+    // x^(p-2)
+    static fe inv(const fe& x) {
+        COUNT_OP(INV);
+        uint64_t e[n];
+        memcpy(e, m, sizeof(e));
+        for (int i = 0, borrow = 2; i < n && borrow; ++i) {
+            uint64_t d = e[i] - borrow;
+            borrow = e[i] < (uint64_t)borrow;
+            e[i] = d;
+        }
+        fe res = r1;
+        for (int i = n - 1; i >= 0; --i)
+            for (int j = 63; j >= 0; --j) {
+                sqr(res, res);
+                if (e[i] >> j & 1) mul(res, res, x);
+            }
+        return res;
+    }
+
+    static bool is_zero(const fe& x) {
+        uint64_t acc = 0;
+        for (int i = 0; i < n; ++i) acc |= x.v[i];
+        return acc == 0;
+    }
+    static bool equal(const fe& x, const fe& y) { return memcmp(x.v, y.v, sizeof(x.v)) == 0; }
+};
+
+// p = 2^521 - 1: 9 limbs, the top one holds 9 bits. A product is reduced by
+// adding its bits above 2^521 to the low 521 bits, no Montgomery form needed.
+struct Mersenne_field {
+    static constexpr int n = 9;
+    struct fe {
+        uint64_t v[n];
+    };
+
+    static void init() {}
+
+    static fe from(const bigint& v) {
+        bigint x = v;
+        reduce(x, p);
+        fe r;
+        to_words(x, r.v, n);
+        return r;
+    }
+
+    static bigint to(const fe& x) { return from_words(x.v, n); }
+
+    static fe zero() { return fe{}; }
+    static fe one() {
+        fe r{};
+        r.v[0] = 1;
+        return r;
+    }
+
+    // r < 2^522 to the canonical value in [0, p)
+    static void fold(fe& r) {
+        for (int k = 0; k < 2; ++k) {
+            uint64_t carry = r.v[n - 1] >> 9;
+            r.v[n - 1] &= 0x1ff;
+            for (int i = 0; i < n && carry; ++i) {
+                r.v[i] += carry;
+                carry = r.v[i] < carry;
+            }
+        }
+        uint64_t all = r.v[n - 1] ^ 0x1ff;
+        for (int i = 0; i + 1 < n; ++i) all |= ~r.v[i];
+        if (!all) r = fe{};
+    }
+
+    static void add(fe& r, const fe& x, const fe& y) {
+        uint64_t carry = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 s = (unsigned __int128)x.v[i] + y.v[i] + carry;
+            r.v[i] = (uint64_t)s;
+            carry = (uint64_t)(s >> 64);
+        }
+        fold(r);
+    }
+
+    // x - y == x + (p - y), and p - y is y with its 521 bits flipped
+    static void sub(fe& r, const fe& x, const fe& y) {
+        fe t;
+        for (int i = 0; i < n; ++i) t.v[i] = ~y.v[i];
+        t.v[n - 1] &= 0x1ff;
+        add(r, x, t);
+    }
+
+    static void mul(fe& r, const fe& x, const fe& y) {
+        COUNT_OP(MUL);
+        mul_(r, x, y);
+    }
+
+    static void sqr(fe& r, const fe& x) {
+        COUNT_OP(SQR);
+        mul_(r, x, x);
+    }
+
+    static void mul_(fe& r, const fe& x, const fe& y) {
+        uint64_t t[2 * n] = {};
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 c = 0;
+            for (int j = 0; j < n; ++j) {
+                c += (unsigned __int128)x.v[i] * y.v[j] + t[i + j];
+                t[i + j] = (uint64_t)c;
+                c >>= 64;
+            }
+            t[i + n] = (uint64_t)c;
+        }
+        uint64_t carry = 0;
+        for (int i = 0; i < n; ++i) {
+            uint64_t hi = t[i + n - 1] >> 9 | t[i + n] << 55;
+            unsigned __int128 s = (unsigned __int128)(i + 1 < n ? t[i] : t[i] & 0x1ff) + hi + carry;
+            r.v[i] = (uint64_t)s;
+            carry = (uint64_t)(s >> 64);
+        }
+        fold(r);
+    }
+
+    // x^(p-2), p - 2 = 2^521 - 3 has every bit set except bit 1
+    static fe inv(const fe& x) {
+        COUNT_OP(INV);
+        fe res = one();
+        for (int i = 520; i >= 0; --i) {
+            sqr(res, res);
+            if (i != 1) mul(res, res, x);
+        }
+        return res;
+    }
+
+    static bool is_zero(const fe& x) {
+        uint64_t acc = 0;
+        for (int i = 0; i < n; ++i) acc |= x.v[i];
+        return acc == 0;
+    }
+    static bool equal(const fe& x, const fe& y) { return memcmp(x.v, y.v, sizeof(x.v)) == 0; }
+};
+
+// p = 2^255 - 19: 4 full limbs, 2^256 = 38 (mod p), so the high half of a
+// product is folded into the low one with a multiplication by 38.
+struct Curve25519_field {
+    static constexpr int n = 4;
+    struct fe {
+        uint64_t v[n];
+    };
+
+    // (2^256 - 1) / 3 * 3 = 2^256 - 1 = 37 (mod p) sits just below 2^256,
+    // where fold has to wrap bit 255 around before the final subtraction
+    static void init() {
+        fe x, three{}, r;
+        for (int i = 0; i < n; ++i) x.v[i] = ~0ULL / 3;
+        three.v[0] = 3;
+        mul_(r, x, three);
+        if (r.v[0] != 37 || r.v[1] || r.v[2] || r.v[3]) {
+            cerr << "Curve25519_field reduction is broken\n";
+            abort();
+        }
+    }
+
+    static fe from(const bigint& v) {
+        bigint x = v;
+        reduce(x, p);
+        fe r;
+        to_words(x, r.v, n);
+        return r;
+    }
+
+    static bigint to(const fe& x) { return from_words(x.v, n); }
+
+    static fe zero() { return fe{}; }
+    static fe one() {
+        fe r{};
+        r.v[0] = 1;
+        return r;
+    }
+
+    // r + 38 * carry, then r < 2^256 to [0, p)
+    static void fold(fe& r, uint64_t carry) {
+        while (carry) {
+            unsigned __int128 s = (unsigned __int128)carry * 38;
+            for (int i = 0; i < n; ++i) {
+                s += r.v[i];
+                r.v[i] = (uint64_t)s;
+                s >>= 64;
+            }
+            carry = (uint64_t)s;
+        }
+        // bit 255 is worth 19, which leaves r < 2^255 + 19
+        unsigned __int128 s = 19 * (r.v[n - 1] >> 63);
+        r.v[n - 1] &= ~(1ULL << 63);
+        for (int i = 0; i < n; ++i) {
+            s += r.v[i];
+            r.v[i] = (uint64_t)s;
+            s >>= 64;
+        }
+        // r >= p exactly when r + 19 reaches 2^255
+        fe t;
+        s = 19;
+        for (int i = 0; i < n; ++i) {
+            s += r.v[i];
+            t.v[i] = (uint64_t)s;
+            s >>= 64;
+        }
+        if (t.v[n - 1] >> 63) {
+            t.v[n - 1] &= ~(1ULL << 63);
+            r = t;
+        }
+    }
+
+    static void add(fe& r, const fe& x, const fe& y) {
+        uint64_t carry = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 s = (unsigned __int128)x.v[i] + y.v[i] + carry;
+            r.v[i] = (uint64_t)s;
+            carry = (uint64_t)(s >> 64);
+        }
+        fold(r, carry);
+    }
+
+    // x - y == x + (p - y), y < p so p - y needs no borrow out
+    static void sub(fe& r, const fe& x, const fe& y) {
+        static constexpr uint64_t pv[n] = { ~18ULL, ~0ULL, ~0ULL, ~0ULL >> 1 };
+        fe t;
+        uint64_t borrow = 0;
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 d = (unsigned __int128)pv[i] - y.v[i] - borrow;
+            t.v[i] = (uint64_t)d;
+            borrow = (uint64_t)(d >> 64) & 1;
+        }
+        add(r, x, t);
+    }
+
+    static void mul(fe& r, const fe& x, const fe& y) {
+        COUNT_OP(MUL);
+        mul_(r, x, y);
+    }
+
+    static void sqr(fe& r, const fe& x) {
+        COUNT_OP(SQR);
+        mul_(r, x, x);
+    }
+
+    static void mul_(fe& r, const fe& x, const fe& y) {
+        uint64_t t[2 * n] = {};
+        for (int i = 0; i < n; ++i) {
+            unsigned __int128 c = 0;
+            for (int j = 0; j < n; ++j) {
+                c += (unsigned __int128)x.v[i] * y.v[j] + t[i + j];
+                t[i + j] = (uint64_t)c;
+                c >>= 64;
+            }
+            t[i + n] = (uint64_t)c;
+        }
+        unsigned __int128 c = 0;
+        for (int i = 0; i < n; ++i) {
+            c += (unsigned __int128)t[i + n] * 38 + t[i];
+            r.v[i] = (uint64_t)c;
+            c >>= 64;
+        }
+        fold(r, (uint64_t)c);
+    }
+
+    // x^(p-2), p - 2 = 2^255 - 21 has every bit set except bits 2 and 4
+    static fe inv(const fe& x) {
+        COUNT_OP(INV);
+        fe res = one();
+        for (int i = 254; i >= 0; --i) {
+            sqr(res, res);
+            if (i != 2 && i != 4) mul(res, res, x);
+        }
         return res;
     }
+
+    static bool is_zero(const fe& x) {
+        uint64_t acc = 0;
+        for (int i = 0; i < n; ++i) acc |= x.v[i];
+        return acc == 0;
+    }
+    static bool equal(const fe& x, const fe& y) { return memcmp(x.v, y.v, sizeof(x.v)) == 0; }
 };
 
-bigint p, a, b;
+#ifdef FIELD_GMP
+// GMP integers reduced mod p
+struct Gmp_field {
+    typedef mpz_class fe;
+    static inline mpz_class mod;
+    static void init() {
+        ostringstream os;
+        os << p;
+        mod = mpz_class(os.str());
+    }
+    static fe from(const bigint& v) {
+        ostringstream os;
+        os << v;
+        fe r(os.str());
+        mpz_mod(r.get_mpz_t(), r.get_mpz_t(), mod.get_mpz_t());
+        return r;
+    }
+    static bigint to(const fe& x) { return bigint(x.get_str()); }
+    static fe zero() { return 0; }
+    static fe one() { return 1; }
+    static void add(fe& r, const fe& x, const fe& y) {
+        mpz_add(r.get_mpz_t(), x.get_mpz_t(), y.get_mpz_t());
+        if (r >= mod) r -= mod;
+    }
+    static void sub(fe& r, const fe& x, const fe& y) {
+        mpz_sub(r.get_mpz_t(), x.get_mpz_t(), y.get_mpz_t());
+        if (sgn(r) < 0) r += mod;
+    }
+    static void mul(fe& r, const fe& x, const fe& y) {
+        COUNT_OP(MUL);
+        mul_(r, x, y);
+    }
+    static void sqr(fe& r, const fe& x) {
+        COUNT_OP(SQR);
+        mul_(r, x, x);
+    }
+    static void mul_(fe& r, const fe& x, const fe& y) {
+        mpz_mul(r.get_mpz_t(), x.get_mpz_t(), y.get_mpz_t());
+        mpz_mod(r.get_mpz_t(), r.get_mpz_t(), mod.get_mpz_t());
+    }
+    static fe inv(const fe& x) {
+        COUNT_OP(INV);
+        fe r = 0;
+        if (sgn(x) != 0) mpz_invert(r.get_mpz_t(), x.get_mpz_t(), mod.get_mpz_t());
+        return r;
+    }
+    static bool is_zero(const fe& x) { return sgn(x) == 0; }
+    static bool equal(const fe& x, const fe& y) { return x == y; }
+};
+#endif
 
+// field backend of each curve
+#if defined(FIELD_GMP)
+template<typename Curve>
+struct Field_of {
+    typedef Gmp_field type;
+};
+#elif defined(FIELD_BIGINT)
+template<typename Curve>
+struct Field_of {
+    typedef Bigint_field type;
+};
+#else
+// P-256 and P-384 run on the generic Montgomery reduction of Fixed_field; their
+// Solinas primes would allow a cheaper fold, which is not implemented
+template<typename Curve>
+struct Field_of {
+    typedef Fixed_field<Curve> type;
+};
+template<>
+struct Field_of<P521> {
+    typedef Mersenne_field type;
+};
+template<>
+struct Field_of<Ed25519> {
+    typedef Curve25519_field type;
+};
+#endif
 
-template<typename Number_T>
-pair<Number_T, Number_T> Evclide(const Number_T a, const Number_T b) {
-    if (a == 0) {
-        return { 0, 1 };
+// x^e for e given by scalar_bits, least significant bit first
+template<typename F>
+typename F::fe field_pow(const typename F::fe& x, const vector<char>& bits) {
+    typename F::fe res = F::one();
+    for (int i = (int)bits.size() - 1; i >= 0; --i) {
+        F::sqr(res, res);
+        if (bits[i]) F::mul(res, res, x);
     }
-    auto xy = Evclide(b % a, a);
-    auto& x1 = xy.first, y1 = xy.second;
-    return { y1 - (b / a) * x1, x1 };
+    return res;
 }
 
-class Point {
+// projective point (x : y : z) of Curve, x = X / Z, y = Y / Z; z == 0 is the point at infinity
+template<typename Curve>
+class Point_t {
     public:
-    bigint x, y, z;
-    Point() : x(1), y(0), z(0) {};
-    Point(bigint x, bigint y) : x(x), y(y), z(1) {}
-    Point(bigint x, bigint y, bigint z) : x(x), y(y), z(z) {}
+    typedef Curve curve;
+    typedef typename Field_of<Curve>::type F;
+    typedef typename F::fe fe;
+    fe x, y, z;
+    static inline fe a_coef, b_coef; // curve coefficients, set by init()
+    static inline vector<char> sqrt_bits; // (p + 1) / 4
 
-    Point operator-() const {
-        if (z == 0) return Point();
-        if (y == 0) return (*this);
-        return Point(x, -y, z);
+    // makes Curve the curve of the program: p, a, b, deg and the field constants
+    static void init() {
+        p = bigint(Curve::p), a = bigint(Curve::a), b = bigint(Curve::b), deg = bigint(Curve::n);
+        F::init();
+        a_coef = F::from(a);
+        b_coef = F::from(b);
+        sqrt_bits = scalar_bits((p + 1) / 4);
     }
 
-    Point operator+(const Point& other) const {
-        if (other.z == 0) return *this;
-        if (this->z == 0) return other;
+    Point_t() : x(F::zero()), y(F::zero()), z(F::zero()) {};
+    Point_t(const bigint& x, const bigint& y) : x(F::from(x)), y(F::from(y)), z(F::one()) {}
+    Point_t(fe x, fe y, fe z) : x(move(x)), y(move(y)), z(move(z)) {}
+
+    Point_t operator-() const {
+        if (is_infty_()) return Point_t();
+        Point_t res = *this;
+        F::sub(res.y, F::zero(), y);
+        return res;
+    }
+
+    Point_t operator+(const Point_t& other) const {
+        OP_SCOPE("Point::operator+");
+        return add_<false>(other);
+    }
+
+    // this + other for other with z == 1, saves the multiplications by z2
+    Point_t add_affine(const Point_t& other) const {
+        OP_SCOPE("Point::add_affine");
+        return add_<true>(other);
+    }
+
+    // the same point with z == 1, or itself if that is already so
+    Point_t normalized() const {
+        if (is_infty_() || F::equal(z, F::one())) return *this;
+        auto xy = affine();
+        return Point_t(xy.first, xy.second);
+    }
+
+    template<bool z2_one>
+    Point_t add_(const Point_t& other) const {
+        if (other.is_infty_()) return *this;
+        if (this->is_infty_()) return other;
         const auto& x1 = this->x;
         const auto& y1 = this->y;
         const auto& z1 = this->z;
         const auto& x2 = other.x;
         const auto& y2 = other.y;
         const auto& z2 = other.z;
-        bigint k;
-        bigint deter;
-        if ((x1 * z2 - x2 * z1) % p == bigint(0)) {
-            if ((y1 * z2 + y2 * z1) % p == bigint(0)) {
-                return Point();
+        fe u1, u2, v1, v2, t;
+        if constexpr (z2_one) u1 = x1, v1 = y1;
+        else F::mul(u1, x1, z2), F::mul(v1, y1, z2);
+        F::mul(u2, x2, z1);
+        F::mul(v2, y2, z1);
+        fe k, deter;
+        if (F::equal(u1, u2)) {
+            F::add(t, v1, v2);
+            if (F::is_zero(t)) {
+                return Point_t();
             }
-            k = bigint(3) * x1 * x1 + a * z1 * z1;
-            deter = bigint(2) * y1 * z1;
+            F::sqr(t, x1);
+            F::add(k, t, t);
+            F::add(k, k, t);
+            F::sqr(t, z1);
+            F::mul(t, t, a_coef);
+            F::add(k, k, t);
+            F::mul(deter, y1, z1);
+            F::add(deter, deter, deter);
         } else {
-            k = y2 * z1 - y1 * z2;
-            deter = x2 * z1 - x1 * z2;
-        }
-        auto z1z2 = (z1 * z2) % p;
-        auto deter2 = (deter * deter) % p;
-        bigint x3 = k * k * z1z2 - (x1 * z2 + x2 * z1) * deter2;
-        bigint z3 = z1z2 * deter2;
-        bigint y3 = k * (x3 * z1 - x1 * z3) + y1 * deter * z3;
-        x3 = x3 * z1 * deter;
-        z3 = z3 * z1 * deter;
-        y3 = (p + y3 % p) % p;
-        x3 = (p + x3 % p) % p;
-        z3 = (p + z3 % p) % p;
-        return -Point(x3, y3, z3);
+            F::sub(k, v2, v1);
+            F::sub(deter, u2, u1);
+        }
+        fe z1z2, deter2, x3, y3, z3;
+        if constexpr (z2_one) z1z2 = z1;
+        else F::mul(z1z2, z1, z2);
+        F::sqr(deter2, deter);
+        F::sqr(x3, k);
+        F::mul(x3, x3, z1z2);
+        F::add(u1, u1, u2);
+        F::mul(t, u1, deter2);
+        F::sub(x3, x3, t);
+        F::mul(z3, z1z2, deter2);
+        F::mul(t, x3, z1);
+        F::mul(u1, x1, z3);
+        F::sub(t, t, u1);
+        F::mul(y3, k, t);
+        F::mul(t, y1, deter);
+        F::mul(t, t, z3);
+        F::add(y3, y3, t);
+        F::mul(t, z1, deter);
+        F::mul(x3, x3, t);
+        F::mul(z3, z3, t);
+        return -Point_t(move(x3), move(y3), move(z3));
     }
     bool is_infty_() const {
-        return z == 0;
+        return F::is_zero(z);
     }
-    bool operator!=(const Point& other) const {
-        return (this->x * other.z - other.x * this->z) % p != 0 ||
-            (this->y * other.z - other.y * this->z) % p != 0;
+    bool operator!=(const Point_t& other) const {
+        fe l, r;
+        F::mul(l, x, other.z);
+        F::mul(r, other.x, z);
+        if (!F::equal(l, r)) return true;
+        F::mul(l, y, other.z);
+        F::mul(r, other.y, z);
+        return !F::equal(l, r);
+    }
+    // affine coordinates as integers in [0, p)
+    pair<bigint, bigint> affine() const {
+        fe zrev = F::inv(z), x_a, y_a;
+        F::mul(x_a, x, zrev);
+        F::mul(y_a, y, zrev);
+        return { F::to(x_a), F::to(y_a) };
     }
-};
 
-bigint rev(const bigint& num) {
-    auto res = Evclide(num, p).first;
-    return (p + res % p) % p;
-}
+    // (x, y) has coordinates in [0, p) and satisfies y^2 = x^3 + a * x + b
+    static bool on_curve(const bigint& x_, const bigint& y_) {
+        if (x_ < 0 || y_ < 0 || x_ >= p || y_ >= p) return false;
+        fe x = F::from(x_), y = F::from(y_), l, r;
+        F::sqr(l, y);
+        F::sqr(r, x);
+        F::add(r, r, a_coef);
+        F::mul(r, r, x);
+        F::add(r, r, b_coef);
+        return F::equal(l, r);
+    }
+
+    // y with (x, y) on the curve, false if x^3 + a * x + b is not a square; p = 3 (mod 4)
+    static bool lift(const bigint& x_, bigint& y_) {
+        fe x = F::from(x_), v, t, r;
+        F::sqr(v, x);
+        F::add(v, v, a_coef);
+        F::mul(v, v, x);
+        F::add(v, v, b_coef);
+        r = field_pow<F>(v, sqrt_bits);
+        F::sqr(t, r);
+        y_ = F::to(r);
+        return F::equal(t, v);
+    }
+};
 
-ostream& operator<<(ostream& os, const Point& num)
+template<typename Curve>
+ostream& operator<<(ostream& os, const Point_t<Curve>& num)
 {
+    Stage_timer timer(OUTPUT);
     if (num.is_infty_()) os << "Z";
     else {
-        auto zrev = rev(num.z);
-        os << (num.x * zrev) % p << ' ' << (num.y * zrev) % p;
+        auto xy = num.affine();
+        os << xy.first << ' ' << xy.second;
     }
     return os;
 }
 
+// extended point (X : Y : Z : T) of a twisted Edwards curve with a = -1,
+// x = X / Z, y = Y / Z, x * y = T / Z. The neutral element is (0 : 1 : 1 : 0);
+// d is not a square, so the addition law has no exceptional cases.
+template<typename Curve>
+class Edwards_t {
+    public:
+    typedef Curve curve;
+    typedef typename Field_of<Curve>::type F;
+    typedef typename F::fe fe;
+    fe x, y, z, t;
+    static inline fe d_coef, d2_coef, sqrt_m1; // d, 2 * d and a root of -1, set by init()
+    static inline vector<char> sqrt_bits; // (p + 3) / 8
+
+    // makes Curve the curve of the program; b holds d
+    static void init() {
+        p = bigint(Curve::p), a = bigint(Curve::a), b = bigint(Curve::d), deg = bigint(Curve::n);
+        F::init();
+        d_coef = F::from(b);
+        F::add(d2_coef, d_coef, d_coef);
+        fe two;
+        F::add(two, F::one(), F::one());
+        sqrt_m1 = field_pow<F>(two, scalar_bits((p - 1) / 4));
+        sqrt_bits = scalar_bits((p + 3) / 8);
+    }
+
+    Edwards_t() : x(F::zero()), y(F::one()), z(F::one()), t(F::zero()) {};
+    Edwards_t(const bigint& x, const bigint& y) : x(F::from(x)), y(F::from(y)), z(F::one()) {
+        F::mul(t, this->x, this->y);
+    }
+    Edwards_t(fe x, fe y, fe z, fe t) : x(move(x)), y(move(y)), z(move(z)), t(move(t)) {}
+
+    Edwards_t operator-() const {
+        Edwards_t res = *this;
+        F::sub(res.x, F::zero(), x);
+        F::sub(res.t, F::zero(), t);
+        return res;
+    }
+
+    Edwards_t operator+(const Edwards_t& other) const {
+        OP_SCOPE("Point::operator+");
+        return add_<false>(other);
+    }
+
+    // this + other for other with z == 1
+    Edwards_t add_affine(const Edwards_t& other) const {
+        OP_SCOPE("Point::add_affine");
+        return add_<true>(other);
+    }
+
+    Edwards_t normalized() const {
+        if (F::equal(z, F::one())) return *this;
+        auto xy = affine();
+        return Edwards_t(xy.first, xy.second);
+    }
+
+    template<bool z2_one>
+    Edwards_t add_(const Edwards_t& other) const {
+        fe e, f, g, h, u;
+        F::sub(e, y, x);
+        F::sub(u, other.y, other.x);
+        F::mul(e, e, u);
+        F::add(h, y, x);
+        F::add(u, other.y, other.x);
+        F::mul(h, h, u);
+        F::mul(f, t, d2_coef);
+        F::mul(f, f, other.t);
+        if constexpr (z2_one) g = z;
+        else F::mul(g, z, other.z);
+        F::add(g, g, g);
+        F::sub(u, g, f);
+        F::add(g, g, f);
+        F::sub(f, h, e);
+        F::add(h, h, e);
+        Edwards_t res;
+        F::mul(res.x, f, u);
+        F::mul(res.y, g, h);
+        F::mul(res.t, f, h);
+        F::mul(res.z, u, g);
+        return res;
+    }
+
+    Edwards_t dbl() const {
+        fe xx, yy, zz, e, g, f, h;
+        F::sqr(xx, x);
+        F::sqr(yy, y);
+        F::sqr(zz, z);
+        F::add(zz, zz, zz);
+        F::add(e, x, y);
+        F::sqr(e, e);
+        F::sub(e, e, xx);
+        F::sub(e, e, yy);
+        F::sub(g, yy, xx);
+        F::sub(f, g, zz);
+        F::sub(h, F::zero(), xx);
+        F::sub(h, h, yy);
+        Edwards_t res;
+        F::mul(res.x, e, f);
+        F::mul(res.y, g, h);
+        F::mul(res.t, e, h);
+        F::mul(res.z, f, g);
+        return res;
+    }
+
+    bool is_infty_() const {
+        return F::is_zero(x) && F::equal(y, z);
+    }
+    // affine coordinates as integers in [0, p)
+    pair<bigint, bigint> affine() const {
+        fe zrev = F::inv(z), x_a, y_a;
+        F::mul(x_a, x, zrev);
+        F::mul(y_a, y, zrev);
+        return { F::to(x_a), F::to(y_a) };
+    }
+
+    // (x, y) has coordinates in [0, p) and satisfies -x^2 + y^2 = 1 + d * x^2 * y^2
+    static bool on_curve(const bigint& x_, const bigint& y_) {
+        if (x_ < 0 || y_ < 0 || x_ >= p || y_ >= p) return false;
+        fe x = F::from(x_), y = F::from(y_), xx, yy, l, r;
+        F::sqr(xx, x);
+        F::sqr(yy, y);
+        F::sub(l, yy, xx);
+        F::mul(r, xx, yy);
+        F::mul(r, r, d_coef);
+        F::add(r, r, F::one());
+        return F::equal(l, r);
+    }
+
+    // y with (x, y) on the curve: y^2 = (1 + x^2) / (1 - d * x^2), p = 5 (mod 8)
+    static bool lift(const bigint& x_, bigint& y_) {
+        fe x = F::from(x_), xx, num, den, v, r, rr;
+        F::sqr(xx, x);
+        F::add(num, F::one(), xx);
+        F::mul(den, d_coef, xx);
+        F::sub(den, F::one(), den);
+        F::mul(v, num, F::inv(den));
+        r = field_pow<F>(v, sqrt_bits);
+        F::sqr(rr, r);
+        if (!F::equal(rr, v)) {
+            F::mul(r, r, sqrt_m1);
+            F::sqr(rr, r);
+        }
+        y_ = F::to(r);
+        return F::equal(rr, v);
+    }
+
+    // u = (1 + y) / (1 - y) of the equivalent point on the Montgomery curve
+    bigint mont_u() const {
+        fe num, den;
+        F::add(num, z, y);
+        F::sub(den, z, y);
+        F::mul(num, num, F::inv(den));
+        return F::to(num);
+    }
+
+    // x-only Montgomery ladder on Curve25519 (v^2 = u^3 + 486662 u^2 + u), returns u(st * P)
+    static bigint ladder(const bigint& st, const bigint& u) {
+        OP_SCOPE("ladder");
+        auto bits = scalar_bits(st);
+        fe a24 = F::from(bigint(121665));
+        fe x1 = F::from(u), x2 = F::one(), z2 = F::zero(), x3 = x1, z3 = F::one();
+        fe aa, bb, e, c, d, da, cb, s;
+        bool swapped = false;
+        for (int i = (int)bits.size() - 1; i >= 0; --i) {
+            if (swapped != (bool)bits[i]) {
+                swap(x2, x3);
+                swap(z2, z3);
+                swapped = bits[i];
+            }
+            F::add(s, x2, z2);
+            F::sub(e, x2, z2);
+            F::add(c, x3, z3);
+            F::sub(d, x3, z3);
+            F::mul(da, d, s);
+            F::mul(cb, c, e);
+            F::sqr(aa, s);
+            F::sqr(bb, e);
+            F::sub(e, aa, bb);
+            F::add(s, da, cb);
+            F::sqr(x3, s);
+            F::sub(s, da, cb);
+            F::sqr(s, s);
+            F::mul(z3, x1, s);
+            F::mul(x2, aa, bb);
+            F::mul(s, a24, e);
+            F::add(s, s, aa);
+            F::mul(z2, e, s);
+        }
+        if (swapped) {
+            swap(x2, x3);
+            swap(z2, z3);
+        }
+        F::mul(x2, x2, F::inv(z2));
+        return F::to(x2);
+    }
+};
+
+template<typename Curve>
+ostream& operator<<(ostream& os, const Edwards_t<Curve>& num)
+{
+    Stage_timer timer(OUTPUT);
+    auto xy = num.affine();
+    os << xy.first << ' ' << xy.second;
+    return os;
+}
+
+// group of each curve
+template<typename Curve>
+struct Point_of {
+    typedef Point_t<Curve> type;
+};
+template<>
+struct Point_of<Ed25519> {
+    typedef Edwards_t<Ed25519> type;
+};
+
 int char_to_number(char symbol) {
     if (symbol >= 48 && symbol <= 57)
         return symbol - 48;
@@ -403,6 +1882,8 @@ char number_to_char(int num) {
 }
 
 vector<ll> from_10_to_64(bigint num) {
+    Stage_timer timer(RADIX);
+    OP_SCOPE("from_10_to_64");
     if (num < 0) num = p - num;
     vector<ll> res;
     if (num == 0) return { 0 };
@@ -413,14 +1894,275 @@ vector<ll> from_10_to_64(bigint num) {
     return res;
 }
 
-Point mpow(Point& a, bigint st) {
-    if (st == 0) return Point();
-    Point res = mpow(a, st / 2);
-    res = res + res;
-    if (st.z[0] % 2) res = res + a;
+template<typename Curve>
+Point_t<Curve> mpow(Point_t<Curve>& a, bigint st) {
+    Stage_timer timer(MPOW);
+    OP_SCOPE("mpow");
+    Arena_scope scope;
+    auto bits = scalar_bits(move(st));
+    auto base = a.normalized();
+    Point_t<Curve> res;
+    for (int i = (int)bits.size() - 1; i >= 0; --i) {
+        res = res + res;
+        if (bits[i]) res = res.add_affine(base);
+    }
+    return scope.keep(res);
+}
+
+template<typename Curve>
+Edwards_t<Curve> mpow(Edwards_t<Curve>& a, bigint st) {
+    Stage_timer timer(MPOW);
+    OP_SCOPE("mpow");
+    Arena_scope scope;
+    auto bits = scalar_bits(move(st));
+    auto base = a.normalized();
+    Edwards_t<Curve> res;
+    for (int i = (int)bits.size() - 1; i >= 0; --i) {
+        res = res.dbl();
+        if (bits[i]) res = res.add_affine(base);
+    }
+    return scope.keep(res);
+}
+
+// Hybrid mode: one ephemeral ECDH with the recipient key, HKDF-SHA256 over
+// the shared x-coordinate, ChaCha20 for the payload and HMAC-SHA256 as MAC.
+
+struct Sha256 {
+    uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    uint8_t buf[64];
+    size_t fill = 0;
+    uint64_t len = 0;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void block(const uint8_t* data) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 | (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+    void update(const uint8_t* data, size_t n) {
+        len += n;
+        if (fill) {
+            size_t take = min(n, 64 - fill);
+            memcpy(buf + fill, data, take);
+            fill += take, data += take, n -= take;
+            if (fill < 64) return;
+            block(buf);
+            fill = 0;
+        }
+        for (; n >= 64; data += 64, n -= 64)
+            block(data);
+        memcpy(buf, data, n);
+        fill = n;
+    }
+
+    array<uint8_t, 32> digest() {
+        uint64_t bits = len * 8;
+        uint8_t pad[72] = { 0x80 };
+        size_t pad_len = (fill < 56 ? 56 : 120) - fill;
+        for (int i = 0; i < 8; ++i)
+            pad[pad_len + i] = (uint8_t)(bits >> (56 - 8 * i));
+        update(pad, pad_len + 8);
+        array<uint8_t, 32> res;
+        for (int i = 0; i < 32; ++i)
+            res[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+        return res;
+    }
+};
+
+array<uint8_t, 32> hmac_sha256(const uint8_t* key, size_t key_len, const uint8_t* data, size_t n) {
+    uint8_t k[64] = {};
+    if (key_len > 64) {
+        Sha256 kh;
+        kh.update(key, key_len);
+        auto d = kh.digest();
+        memcpy(k, d.data(), 32);
+    } else {
+        memcpy(k, key, key_len);
+    }
+    uint8_t ipad[64], opad[64];
+    for (int i = 0; i < 64; ++i) {
+        ipad[i] = k[i] ^ 0x36;
+        opad[i] = k[i] ^ 0x5c;
+    }
+    Sha256 inner;
+    inner.update(ipad, 64);
+    inner.update(data, n);
+    auto d = inner.digest();
+    Sha256 outer;
+    outer.update(opad, 64);
+    outer.update(d.data(), 32);
+    return outer.digest();
+}
+
+// RFC 5869 with an empty salt
+vector<uint8_t> hkdf_sha256(const vector<uint8_t>& ikm, const string& info, size_t out_len) {
+    uint8_t salt[32] = {};
+    auto prk = hmac_sha256(salt, 32, ikm.data(), ikm.size());
+    vector<uint8_t> res, t;
+    for (uint8_t i = 1; res.size() < out_len; ++i) {
+        vector<uint8_t> msg = t;
+        msg.insert(msg.end(), info.begin(), info.end());
+        msg.push_back(i);
+        auto d = hmac_sha256(prk.data(), 32, msg.data(), msg.size());
+        t.assign(d.begin(), d.end());
+        res.insert(res.end(), t.begin(), t.end());
+    }
+    res.resize(out_len);
+    return res;
+}
+
+// RFC 8439 ChaCha20 with a zero nonce: every key is used for one message only
+void chacha20_xor(const uint8_t* key, uint8_t* data, size_t n) {
+    auto load = [](const uint8_t* s) {
+        return (uint32_t)s[0] | (uint32_t)s[1] << 8 | (uint32_t)s[2] << 16 | (uint32_t)s[3] << 24;
+    };
+    uint32_t init[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    for (int i = 0; i < 8; ++i)
+        init[4 + i] = load(key + 4 * i);
+    auto rotl = [](uint32_t x, int bits) { return (x << bits) | (x >> (32 - bits)); };
+    for (uint32_t counter = 0; n > 0; ++counter) {
+        init[12] = counter;
+        uint32_t x[16];
+        memcpy(x, init, sizeof(x));
+        auto quarter = [&](int qa, int qb, int qc, int qd) {
+            x[qa] += x[qb]; x[qd] = rotl(x[qd] ^ x[qa], 16);
+            x[qc] += x[qd]; x[qb] = rotl(x[qb] ^ x[qc], 12);
+            x[qa] += x[qb]; x[qd] = rotl(x[qd] ^ x[qa], 8);
+            x[qc] += x[qd]; x[qb] = rotl(x[qb] ^ x[qc], 7);
+        };
+        for (int i = 0; i < 10; ++i) {
+            quarter(0, 4, 8, 12); quarter(1, 5, 9, 13); quarter(2, 6, 10, 14); quarter(3, 7, 11, 15);
+            quarter(0, 5, 10, 15); quarter(1, 6, 11, 12); quarter(2, 7, 8, 13); quarter(3, 4, 9, 14);
+        }
+        uint8_t stream[64];
+        for (int i = 0; i < 16; ++i) {
+            uint32_t v = x[i] + init[i];
+            for (int j = 0; j < 4; ++j)
+                stream[4 * i + j] = (uint8_t)(v >> (8 * j));
+        }
+        size_t take = min(n, (size_t)64);
+        for (size_t i = 0; i < take; ++i)
+            data[i] ^= stream[i];
+        data += take, n -= take;
+    }
+}
+
+// big-endian encoding of a field element, as many bytes as p has
+vector<uint8_t> to_bytes(bigint num) {
+    num = (p + num % p) % p;
+    int len = 0;
+    for (bigint t = p; t > 0; t /= 256) ++len;
+    vector<uint8_t> res(len);
+    for (int i = len - 1; i >= 0; --i) {
+        res[i] = (uint8_t)(num % 256);
+        num /= 256;
+    }
+    return res;
+}
+
+// first 32 bytes: ChaCha20 key, last 32 bytes: HMAC key; the info names the
+// curve and holds the affine coordinates of R, so the keys are bound to R
+vector<uint8_t> hybrid_keys(const bigint& shared_x, const char* curve, const pair<bigint, bigint>& r) {
+    string info = string("ElGamal ") + curve + " hybrid";
+    for (auto& c : { r.first, r.second }) {
+        auto bytes = to_bytes(c);
+        info.append(bytes.begin(), bytes.end());
+    }
+    return hkdf_sha256(to_bytes(shared_x), info, 64);
+}
+
+// x of st * k; Ed25519 keys agree on u of the Montgomery form via the ladder
+template<typename Curve>
+bigint shared_x(Point_t<Curve>& k, const bigint& st) {
+    return mpow(k, st).affine().first;
+}
+template<typename Curve>
+bigint shared_x(const Edwards_t<Curve>& k, const bigint& st) {
+    return Edwards_t<Curve>::ladder(st, k.mont_u());
+}
+
+string to_hex(const uint8_t* data, size_t n) {
+    static const char digits[] = "0123456789abcdef";
+    string res(2 * n, '0');
+    for (size_t i = 0; i < n; ++i) {
+        res[2 * i] = digits[data[i] >> 4];
+        res[2 * i + 1] = digits[data[i] & 15];
+    }
     return res;
 }
 
+vector<uint8_t> from_hex(const string& str) {
+    auto val = [](char c) { return c <= '9' ? c - '0' : (c | 32) - 'a' + 10; };
+    vector<uint8_t> res(str.size() / 2);
+    for (size_t i = 0; i < res.size(); ++i)
+        res[i] = (uint8_t)(val(str[2 * i]) << 4 | val(str[2 * i + 1]));
+    return res;
+}
+
+// returns false if the tag does not match
+template<typename Point>
+bool hybrid_decoding(const bigint& k) {
+    Message_timer message;
+    Stage_timer parse(PARSE);
+    bigint x, y;
+    string ct, tag;
+    // one line each for R, the ciphertext (empty for an empty payload) and the tag
+    cin >> x >> y;
+    getline(cin, ct);
+    getline(cin, ct);
+    getline(cin, tag);
+    Point r(x, y);
+    parse.stop();
+    // R off the curve, the neutral element or a point outside the subgroup of
+    // order deg would let st * R leak bits of the private key
+    if (!Point::on_curve(x, y) || r.is_infty_()
+        || (Point::curve::cofactor > 1 && !mpow(r, deg).is_infty_())) {
+        cerr << "R is not a point of the group\n";
+        return false;
+    }
+    auto keys = hybrid_keys(shared_x(r, k), Point::curve::name, { x, y });
+    auto data = from_hex(ct);
+    auto expected = hmac_sha256(keys.data() + 32, 32, data.data(), data.size());
+    auto got = from_hex(tag);
+    uint8_t diff = got.size() != 32;
+    for (int i = 0; i < 32 && i < got.size(); ++i)
+        diff |= expected[i] ^ got[i];
+    if (diff) {
+        cerr << "authentication failed\n";
+        return false;
+    }
+    chacha20_xor(keys.data(), data.data(), data.size());
+    Stage_timer output(OUTPUT);
+    cout.write((const char*)data.data(), data.size());
+    return true;
+}
+
 template<typename Number_T, typename T>
 Number_T mpow(const Number_T& a, T st) {
     if (st == 0) return 1;
@@ -431,38 +2173,256 @@ Number_T mpow(const Number_T& a, T st) {
 }
 template<typename T>
 bigint mpow_p(const bigint& a, T st) {
-    if (st == 0) return 1;
-    bigint res = mpow_p(a, st / 2);
-    res *= res;
-    if (st % 2) res *= a;
-    return res % p;
+    Stage_timer timer(MPOW);
+    OP_SCOPE("mpow_p");
+    Arena_scope scope;
+    auto bits = scalar_bits(st);
+    bigint res = 1;
+    for (int i = (int)bits.size() - 1; i >= 0; --i) {
+        sqrmod(res, res, p);
+        if (bits[i]) mulmod(res, res, a, p);
+    }
+    return scope.keep(res);
 }
 
-int main() {
-    ios_base::sync_with_stdio(false);
-    cin.tie(NULL);
-    cout.tie(NULL);
-    p = mpow(bigint(2), 256) - mpow(bigint(2), 224) + mpow(bigint(2), 192) + mpow(bigint(2), 96) - bigint(1);
-    a = bigint(-3);
-    b = bigint("41058363725152142129326129780047268409114441015993725554835256314039467401291");
-    bigint k; cin >> k;
-    int n; cin >> n;
-    for (int i = 0; i < n; ++i) {
-        Point r, m;
-        r.z = 1;
-        m.z = 1;
-        cin >> r.x >> r.y;
-        cin >> m.x >> m.y;
-        auto s = mpow(r, k);
-        auto res = -s + m;
-        if (res.z < 0) res.z = p + res.z;
-        auto mes = res.x * rev(res.z) % p;
-
-        auto mes64 = from_10_to_64(mes);
+template<typename Point>
+bigint Ell_Gamal_encoding(Point& r, const Point& m, const bigint& k) {
+    Message_timer message;
+    OP_SCOPE("decrypt");
+    auto s = mpow(r, k);
+    auto res = (-s).add_affine(m); // m is read with z == 1
+    if (res.is_infty_()) return 0;
+    return res.affine().first;
+}
+
+// The ciphertext after the header, read at once and parsed in place
+class Cipher_reader {
+    string buf;
+    const char* pos;
+    const char* end;
+
+    void skip_ws() {
+        while (pos < end && isspace((unsigned char)*pos)) ++pos;
+    }
+
+    public:
+    explicit Cipher_reader(istream& in) : buf(istreambuf_iterator<char>(in), istreambuf_iterator<char>()) {
+        pos = buf.data(), end = buf.data() + buf.size();
+    }
+
+    Cipher_reader& operator>>(bigint& v) {
+        skip_ws();
+        pos = v.parse(pos, end);
+        return *this;
+    }
+
+    Cipher_reader& operator>>(int& v) {
+        bigint t;
+        *this >> t;
+        v = (int)t.longValue();
+        return *this;
+    }
+};
+
+template<typename Point>
+void read_message(Cipher_reader& in, Point& r, Point& m) {
+    Stage_timer timer(PARSE);
+    bigint x, y;
+    in >> x >> y;
+    r = Point(x, y);
+    in >> x >> y;
+    m = Point(x, y);
+}
+
+// inverse of the encryptor's chunk embedding
+constexpr int chunk_chars = 40;
+constexpr int pad_bits = 8;
+
+void chunk_to_str(bigint x) {
+    bigint shift = mpow(bigint(64), chunk_chars);
+    x /= 1 << pad_bits;
+    auto len = (x / shift).longValue();
+    auto mes64 = from_10_to_64(x % shift);
+    mes64.resize(len, 0);
+    Stage_timer output(OUTPUT);
+    for (auto el : mes64) {
+        cout << number_to_char(el);
+    }
+}
+
+// the points of one message: a single pair, or a count and that many chunk pairs
+template<typename Point>
+vector<pair<Point, Point>> read_record(Cipher_reader& in, bool chunked) {
+    int chunks = 1;
+    if (chunked) in >> chunks;
+    vector<pair<Point, Point>> rec(max(chunks, 0));
+    for (auto& [r, m] : rec) read_message(in, r, m);
+    return rec;
+}
+
+template<typename Point>
+vector<bigint> decrypt_record(vector<pair<Point, Point>>& rec, const bigint& k) {
+    vector<bigint> xs;
+    for (auto& [r, m] : rec) xs.push_back(Ell_Gamal_encoding(r, m, k));
+    return xs;
+}
+
+template<typename Curve>
+void print_message(const vector<bigint>& xs, bool chunked) {
+    if (chunked) {
+        for (auto& x : xs) chunk_to_str(x);
+    } else {
+        auto mes64 = from_10_to_64(xs[0] / (1 << Curve::plain_pad_bits));
+        Stage_timer output(OUTPUT);
         for (auto el : mes64) {
             cout << number_to_char(el);
         }
-        cout << '\n';
     }
+    cout << '\n';
+}
+
+// --pipeline: a reader thread parses messages into a queue, workers decrypt
+// them and the calling thread prints the results in input order. Messages
+// travel in jobs of `batch` to keep locking off the per-message path, and at
+// most `capacity` jobs are between the reader and the printer at once.
+template<typename Curve>
+class Pipeline {
+    typedef typename Point_of<Curve>::type Point;
+    static constexpr int batch = 16;
+    struct Job {
+        size_t seq;
+        vector<vector<pair<Point, Point>>> recs;
+    };
 
-}
\ No newline at end of file
+    const bigint& k;
+    int n;
+    bool chunked;
+    size_t capacity;
+    deque<Job> jobs;
+    map<size_t, vector<vector<bigint>>> done;
+    size_t parsed = 0, written = 0;
+    bool eof = false;
+    mutex mtx;
+    condition_variable not_full, not_empty, ready;
+
+    void read() {
+        Stage_timer load(PARSE);
+        Cipher_reader in(cin);
+        load.stop();
+        for (int i = 0; i * batch < n; ++i) {
+            Job job{ (size_t)i, {} };
+            for (int j = i * batch; j < min(n, (i + 1) * batch); ++j) {
+                job.recs.push_back(read_record<Point>(in, chunked));
+            }
+            unique_lock<mutex> lock(mtx);
+            not_full.wait(lock, [&] { return parsed - written < capacity; });
+            jobs.push_back(move(job));
+            ++parsed;
+            lock.unlock();
+            not_empty.notify_one();
+        }
+        lock_guard<mutex> lock(mtx);
+        eof = true;
+        not_empty.notify_all();
+    }
+
+    void work() {
+        while (true) {
+            unique_lock<mutex> lock(mtx);
+            not_empty.wait(lock, [&] { return eof || !jobs.empty(); });
+            if (jobs.empty()) return;
+            Job job = move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            vector<vector<bigint>> res;
+            for (auto& rec : job.recs) res.push_back(decrypt_record(rec, k));
+            lock.lock();
+            done[job.seq] = move(res);
+            lock.unlock();
+            ready.notify_one();
+        }
+    }
+
+    public:
+    Pipeline(const bigint& k, int n, bool chunked, size_t capacity)
+        : k(k), n(n), chunked(chunked), capacity(capacity) {}
+
+    void run(int threads) {
+        vector<thread> workers;
+        workers.emplace_back(&Pipeline::read, this);
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back(&Pipeline::work, this);
+        }
+        for (size_t seq = 0; seq * batch < (size_t)n; ++seq) {
+            unique_lock<mutex> lock(mtx);
+            ready.wait(lock, [&] { return done.count(seq); });
+            auto res = move(done[seq]);
+            done.erase(seq);
+            lock.unlock();
+            for (auto& xs : res) print_message<Curve>(xs, chunked);
+            lock.lock();
+            ++written;
+            lock.unlock();
+            not_full.notify_one();
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+};
+
+template<typename Curve>
+int run(bool hybrid, bool chunked, int pipeline_threads) {
+    typedef typename Point_of<Curve>::type Point;
+    Point::init();
+    Stage_timer parse(PARSE);
+    bigint k; cin >> k;
+    int n = 0;
+    if (!hybrid) cin >> n;
+    parse.stop();
+    if (hybrid) {
+        return hybrid_decoding<Point>(k) ? 0 : 1;
+    }
+    if (pipeline_threads > 0) {
+        Pipeline<Curve>(k, n, chunked, 64).run(pipeline_threads);
+        return 0;
+    }
+    Stage_timer load(PARSE);
+    Cipher_reader in(cin);
+    load.stop();
+    for (int i = 0; i < n; ++i) {
+        auto rec = read_record<Point>(in, chunked);
+        print_message<Curve>(decrypt_record(rec, k), chunked);
+    }
+    return 0;
+}
+int main(int argc, char* argv[]) {
+    // --hybrid: decrypt one payload produced by the encryptor's --hybrid mode
+    // --chunked: every word is a count followed by that many chunk points
+    // --pipeline [threads]: parse, decrypt and print on separate threads
+    // --curve P-256 | P-384 | P-521 | Ed25519
+    bool hybrid = false, chunked = false;
+    int pipeline_threads = 0;
+    string curve = "P-256";
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--curve" && i + 1 < argc) curve = argv[++i];
+        if (arg == "--hybrid") hybrid = true;
+        if (arg == "--chunked") chunked = true;
+        if (arg == "--stats") stats.enabled = true;
+        if (arg == "--stats-json" && i + 1 < argc) stats.enabled = true, stats.json_path = argv[++i];
+        if (arg == "--pipeline") {
+            pipeline_threads = max(1, (int)thread::hardware_concurrency() - 2);
+            if (i + 1 < argc && isdigit(argv[i + 1][0])) pipeline_threads = atoi(argv[++i]);
+        }
+    }
+    ios_base::sync_with_stdio(false);
+    cin.tie(NULL);
+    cout.tie(NULL);
+    if (curve == "P-256") return run<P256>(hybrid, chunked, pipeline_threads);
+    if (curve == "P-384") return run<P384>(hybrid, chunked, pipeline_threads);
+    if (curve == "P-521") return run<P521>(hybrid, chunked, pipeline_threads);
+    if (curve == "Ed25519") return run<Ed25519>(hybrid, chunked, pipeline_threads);
+    cerr << "unknown curve " << curve << '\n';
+    return 1;
+}